@@ -68,7 +68,7 @@ void main_bridge(void)
     nrf_init();
     nrf_config_set(&config);
     
-    nrf_rcv_pkt_start(R_CONFIG_EN_CRC);
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC);
     while(1){
         int l, i, status;
         CDC_OutBufAvailChar (&l);
@@ -81,10 +81,10 @@ void main_bridge(void)
                     switch( cmd ){
                         case '1':
                             // can we loose packets here?
-                            nrf_rcv_pkt_end();
+                            nrf_rcv_irq_end();
                             status=snd_pkt_no_crc(serialmsg_len, serialmsg_message);
                             //status=nrf_snd_pkt_crc(serialmsg_len, serialmsg_message);
-                            nrf_rcv_pkt_start(R_CONFIG_EN_CRC);
+                            nrf_rcv_irq_start(R_CONFIG_EN_CRC);
                         break;
                         case '3':
                             memcpy(config.txmac, serialmsg_message, 5);
@@ -133,7 +133,7 @@ void main_bridge(void)
         }
         int len;
         uint8_t buf[32];
-        len=nrf_rcv_pkt_poll(sizeof(buf),buf);
+        len=nrf_rcv_irq_get(sizeof(buf),buf,NULL);
         if( len > 0 ){
             gpioSetValue (RB_LED2, led2);led2=1-led2;
             puts("\\1");
@@ -112,6 +112,8 @@
 #define RB_NRF_CE_IO		IOCON_PIO1_5
 #define RB_SPI_NRF_CS		1,10
 #define RB_SPI_NRF_CS_IO	IOCON_PIO1_10
+#define RB_NRF_IRQ		0,7
+#define RB_NRF_IRQ_IO		IOCON_PIO0_7
 
 // Misc
 #define RB_BUSINT		3,0
@@ -166,7 +168,7 @@ void input(char prompt[], char line[], uint8_t asciistart, uint8_t asciiend, uin
 void iap_entry(uint32_t param_tab[], uint32_t result_tab[]);
 
 // crc.c
-uint16_t crc16(uint8_t * buf, int len);
+#include "basic/crc.h"
 
 // menu.c
 
@@ -205,6 +207,10 @@ const char* IntToStr(int num, unsigned int mxlen, char flag);
 
 #include "basic/simpletime.h"
 
+// sspbus.c
+
+#include "basic/sspbus.h"
+
 // global
 #define SYSTICKSPEED 10
 
@@ -31,6 +31,7 @@ struct CDESC the_config[]= {
     {"l0nick",           0,     0, 1  , 0, 0},
     {"chargeled",        0,     0, 1  , 0, 0},
     {"positionleds",     0,     0, 1  , 0, 0},
+    {"meshdigest",       0,     0, 1  , 1, CFG_TYPE_DEVEL},
     { NULL,              0,     0, 0  , 0, 0},
 };
 
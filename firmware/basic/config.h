@@ -45,6 +45,7 @@ extern char nickl0[];
 #define GLOBALl0nick       (the_config[16].value)
 #define GLOBALchargeled    (the_config[17].value)
 #define GLOBALpositionleds (the_config[18].value)
+#define GLOBALmeshdigest   (the_config[19].value)
 #define GLOBALnickname     (nickname)
 #define GLOBALnickfont     (nickfont)
 #define GLOBALnickl0       (nickl0)
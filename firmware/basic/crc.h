@@ -0,0 +1,23 @@
+#ifndef _CRC_H_
+#define _CRC_H_
+#include <stdint.h>
+
+/* CRC-16/CCITT (poly 0x1021, init 0xffff). Pick the implementation
+ * with -DCRC_VARIANT=...: */
+#define CRC_LOOP   0 /* shift/xor, no table, default */
+#define CRC_NIBBLE 1 /* 16 entry table (32 bytes flash) */
+#define CRC_TABLE  2 /* 256 entry table (512 bytes flash), fastest */
+
+#ifndef CRC_VARIANT
+#define CRC_VARIANT CRC_LOOP
+#endif
+
+uint16_t crc16(uint8_t * buf, int len);
+
+// incremental interface:
+//   crc=crc16_init(); crc=crc16_update(crc,...); ... crc16_final(crc)
+#define crc16_init()     (0xffff)
+#define crc16_final(crc) ((uint16_t)(crc))
+uint16_t crc16_update(uint16_t crc, const uint8_t * buf, int len);
+
+#endif
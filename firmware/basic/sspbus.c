@@ -0,0 +1,152 @@
+#include <sysinit.h>
+#include "basic/basic.h"
+#include "basic/sspbus.h"
+#include "core/ssp/ssp.h"
+
+#define SSPBUS_CR0(dss) ((dss) | SSP_SSP0CR0_FRF_SPI | SSP_SSP0CR0_SCR_8)
+#define SSPBUS_IDLE_CR0 SSPBUS_CR0(SSP_SSP0CR0_DSS_8BIT)
+#define SSPBUS_IDLE_CPSR SSP_SSP0CPSR_CPSDVSR_DIV2
+
+static struct {
+    uint32_t cr0;
+    uint32_t cpsr;
+    void (*deferred)(void);
+    uint8_t prev;       // owner to return to after a nested transaction
+    uint8_t prevdepth;
+    uint32_t start;     // sspFrames at acquire
+} sspbusdev[SSPBUS_DEVICES] = {
+    [SSPBUS_NRF] = { SSPBUS_IDLE_CR0, SSPBUS_IDLE_CPSR },
+    [SSPBUS_DF]  = { SSPBUS_IDLE_CR0, SSPBUS_IDLE_CPSR },
+    /* the LCD requires 9-Bit frames */
+    [SSPBUS_LCD] = { SSPBUS_CR0(SSP_SSP0CR0_DSS_9BIT), SSPBUS_IDLE_CPSR },
+};
+
+struct sspbus_stats sspbusStats[SSPBUS_DEVICES];
+volatile uint8_t sspbusPending=0;
+
+static volatile uint8_t sspbus_owner=SSPBUS_NONE;
+static uint8_t sspbus_depth=0;
+
+static void sspbus_config(uint8_t dev){
+#ifdef __arm__
+    uint32_t cr0=SSPBUS_IDLE_CR0, cpsr=SSPBUS_IDLE_CPSR;
+
+    if(dev!=SSPBUS_NONE){
+        cr0=sspbusdev[dev].cr0;
+        cpsr=sspbusdev[dev].cpsr;
+    };
+    if(SSP_SSP0CR0!=cr0)
+        SSP_SSP0CR0=cr0;
+    if(SSP_SSP0CPSR!=cpsr)
+        SSP_SSP0CPSR=cpsr;
+#endif
+}
+
+void sspbusSetup(uint8_t dev, uint32_t cr0, uint32_t cpsr){
+    sspbusdev[dev].cr0=cr0;
+    sspbusdev[dev].cpsr=cpsr;
+}
+
+// Called with interrupts disabled.
+static void sspbus_take(uint8_t dev){
+    sspbusdev[dev].prev=sspbus_owner;
+    sspbusdev[dev].prevdepth=sspbus_depth;
+    sspbusdev[dev].start=sspFrames;
+    sspbus_owner=dev;
+    sspbus_depth=1;
+    sspbus_config(dev);
+}
+
+// Run deferred work of all devices, each in its own transaction.
+static void sspbus_run_deferred(uint8_t preempt){
+    void (*fn)(void);
+
+    while(sspbusPending){
+        sspbusPending=0;
+        for(uint8_t dev=0;dev<SSPBUS_DEVICES;dev++){
+            __disable_irq();
+            fn=sspbusdev[dev].deferred;
+            sspbusdev[dev].deferred=NULL;
+            __enable_irq();
+            if(fn==NULL)
+                continue;
+            if(preempt)
+                sspbusStats[dev].preempts++;
+            sspbusAcquire(dev);
+            fn();
+            sspbusRelease(dev);
+        };
+    };
+}
+
+void sspbusAcquire(uint8_t dev){
+    __disable_irq();
+    if(sspbus_owner==dev)
+        sspbus_depth++;
+    else
+        sspbus_take(dev); // nested transaction of another device
+    __enable_irq();
+}
+
+void sspbusRelease(uint8_t dev){
+    uint8_t owner;
+
+    __disable_irq();
+    // a release without acquire is ignored, it must not underflow
+    if(sspbus_owner!=dev || sspbus_depth==0 || --sspbus_depth){
+        __enable_irq();
+        return;
+    };
+    sspbusStats[dev].transactions++;
+    sspbusStats[dev].frames+=sspFrames-sspbusdev[dev].start;
+    owner=sspbus_owner=sspbusdev[dev].prev;
+    sspbus_depth=sspbusdev[dev].prevdepth;
+    sspbus_config(owner);
+    __enable_irq();
+
+    if(owner==SSPBUS_NONE)
+        sspbus_run_deferred(0);
+}
+
+// Only from interrupt context: the thread side can not change
+// the owner while we run.
+int sspbusTryAcquire(uint8_t dev){
+    if(sspbus_owner!=SSPBUS_NONE)
+        return 0;
+    sspbus_take(dev);
+    return 1;
+}
+
+void sspbusDefer(uint8_t dev, void (*fn)(void)){
+    __disable_irq();
+    sspbusdev[dev].deferred=fn;
+    sspbusPending=1;
+    sspbusStats[dev].deferred++;
+    __enable_irq();
+}
+
+// Let deferred work run in the middle of a long transaction.
+// The caller must have deasserted its CS.
+void sspbusYield(uint8_t dev){
+    uint8_t depth;
+
+    if(!sspbusPending || sspbus_owner!=dev)
+        return;
+
+    __disable_irq();
+    sspbusStats[dev].frames+=sspFrames-sspbusdev[dev].start;
+    depth=sspbus_depth;
+    sspbus_owner=SSPBUS_NONE;
+    sspbus_depth=0;
+    sspbus_config(SSPBUS_NONE);
+    __enable_irq();
+
+    sspbus_run_deferred(1);
+
+    __disable_irq();
+    sspbus_owner=dev;
+    sspbus_depth=depth;
+    sspbusdev[dev].start=sspFrames;
+    sspbus_config(dev);
+    __enable_irq();
+}
@@ -0,0 +1,40 @@
+#ifndef _SSPBUS_H_
+#define _SSPBUS_H_
+#include <stdint.h>
+
+/* SSP0 is shared by the radio, the dataflash and the LCD.
+ *
+ * Drivers wrap each transaction (CS low ... CS high) in
+ * sspbusAcquire()/sspbusRelease(). Acquire programs the frame format
+ * and clock of the device, release puts back the 8-bit default for
+ * code that does not know about the arbiter.
+ *
+ * Interrupt handlers use sspbusTryAcquire(); if the bus is taken they
+ * sspbusDefer() their work, which then runs as soon as the owner
+ * releases the bus, or calls sspbusYield() between two chunks of a
+ * long transfer (with its CS high).
+ */
+
+#define SSPBUS_NRF      0
+#define SSPBUS_DF       1
+#define SSPBUS_LCD      2
+#define SSPBUS_DEVICES  3
+#define SSPBUS_NONE     0xff
+
+struct sspbus_stats {
+    uint32_t transactions; // completed acquire/release pairs
+    uint32_t frames;       // frames moved inside those
+    uint32_t deferred;     // work postponed because the bus was busy
+    uint32_t preempts;     // deferred work run from sspbusYield()
+};
+extern struct sspbus_stats sspbusStats[SSPBUS_DEVICES];
+extern volatile uint8_t sspbusPending;
+
+void sspbusSetup(uint8_t dev, uint32_t cr0, uint32_t cpsr);
+void sspbusAcquire(uint8_t dev);
+void sspbusRelease(uint8_t dev);
+int  sspbusTryAcquire(uint8_t dev);
+void sspbusDefer(uint8_t dev, void (*fn)(void));
+void sspbusYield(uint8_t dev);
+
+#endif
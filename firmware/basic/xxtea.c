@@ -55,12 +55,120 @@ void xxtea_cbcmac(uint32_t mac[4], uint32_t *data,
 #define DELTA 0x9e3779b9
 #define MX (((z>>5^y<<2) + (y>>3^z<<4)) ^ ((sum^y) + (k[(p&3)^e] ^ z)))
 
+/* Unrolled kernels for the common sizes: 16 byte (openbeacon) and
+ * 32 byte (mesh, random) packets. The words are kept in registers and
+ * byteswapped on load/store instead of the two htonlp() passes.
+ */
+#define MXP(p) (((z>>5^y<<2) + (y>>3^z<<4)) ^ ((sum^y) + (k[(p)^e] ^ z)))
+
+#ifndef XXTEA_GENERIC_ONLY
+static void xxtea_encode4(uint32_t *v, uint32_t const k[4])
+{
+    uint32_t v0=htonl(v[0]), v1=htonl(v[1]), v2=htonl(v[2]), v3=htonl(v[3]);
+    uint32_t y, z, sum;
+    unsigned rounds, e;
+
+    rounds = 6 + 52/4;
+    sum = 0;
+    z = v3;
+    do {
+        sum += DELTA;
+        e = (sum >> 2) & 3;
+        y = v1; z = v0 += MXP(0);
+        y = v2; z = v1 += MXP(1);
+        y = v3; z = v2 += MXP(2);
+        y = v0; z = v3 += MXP(3);
+    } while (--rounds);
+    v[0]=htonl(v0); v[1]=htonl(v1); v[2]=htonl(v2); v[3]=htonl(v3);
+}
+
+static void xxtea_decode4(uint32_t *v, uint32_t const k[4])
+{
+    uint32_t v0=htonl(v[0]), v1=htonl(v[1]), v2=htonl(v[2]), v3=htonl(v[3]);
+    uint32_t y, z, sum;
+    unsigned rounds, e;
+
+    rounds = 6 + 52/4;
+    sum = rounds*DELTA;
+    y = v0;
+    do {
+        e = (sum >> 2) & 3;
+        z = v2; y = v3 -= MXP(3);
+        z = v1; y = v2 -= MXP(2);
+        z = v0; y = v1 -= MXP(1);
+        z = v3; y = v0 -= MXP(0);
+    } while ((sum -= DELTA) != 0);
+    v[0]=htonl(v0); v[1]=htonl(v1); v[2]=htonl(v2); v[3]=htonl(v3);
+}
+
+static void xxtea_encode8(uint32_t *v, uint32_t const k[4])
+{
+    uint32_t v0=htonl(v[0]), v1=htonl(v[1]), v2=htonl(v[2]), v3=htonl(v[3]);
+    uint32_t v4=htonl(v[4]), v5=htonl(v[5]), v6=htonl(v[6]), v7=htonl(v[7]);
+    uint32_t y, z, sum;
+    unsigned rounds, e;
+
+    rounds = 6 + 52/8;
+    sum = 0;
+    z = v7;
+    do {
+        sum += DELTA;
+        e = (sum >> 2) & 3;
+        y = v1; z = v0 += MXP(0);
+        y = v2; z = v1 += MXP(1);
+        y = v3; z = v2 += MXP(2);
+        y = v4; z = v3 += MXP(3);
+        y = v5; z = v4 += MXP(0);
+        y = v6; z = v5 += MXP(1);
+        y = v7; z = v6 += MXP(2);
+        y = v0; z = v7 += MXP(3);
+    } while (--rounds);
+    v[0]=htonl(v0); v[1]=htonl(v1); v[2]=htonl(v2); v[3]=htonl(v3);
+    v[4]=htonl(v4); v[5]=htonl(v5); v[6]=htonl(v6); v[7]=htonl(v7);
+}
+
+static void xxtea_decode8(uint32_t *v, uint32_t const k[4])
+{
+    uint32_t v0=htonl(v[0]), v1=htonl(v[1]), v2=htonl(v[2]), v3=htonl(v[3]);
+    uint32_t v4=htonl(v[4]), v5=htonl(v[5]), v6=htonl(v[6]), v7=htonl(v[7]);
+    uint32_t y, z, sum;
+    unsigned rounds, e;
+
+    rounds = 6 + 52/8;
+    sum = rounds*DELTA;
+    y = v0;
+    do {
+        e = (sum >> 2) & 3;
+        z = v6; y = v7 -= MXP(3);
+        z = v5; y = v6 -= MXP(2);
+        z = v4; y = v5 -= MXP(1);
+        z = v3; y = v4 -= MXP(0);
+        z = v2; y = v3 -= MXP(3);
+        z = v1; y = v2 -= MXP(2);
+        z = v0; y = v1 -= MXP(1);
+        z = v7; y = v0 -= MXP(0);
+    } while ((sum -= DELTA) != 0);
+    v[0]=htonl(v0); v[1]=htonl(v1); v[2]=htonl(v2); v[3]=htonl(v3);
+    v[4]=htonl(v4); v[5]=htonl(v5); v[6]=htonl(v6); v[7]=htonl(v7);
+}
+#endif
+
 void xxtea_encode_words(uint32_t *v, int n, uint32_t const k[4])
 {
     //if(k[0] == 0 && k[1] == 0 && k[2] == 0 && k[3] == 0) return;
     uint32_t y, z, sum;
     unsigned p, rounds, e;
 
+#ifndef XXTEA_GENERIC_ONLY
+    if(n == 4){
+        xxtea_encode4(v, k);
+        return;
+    }
+    if(n == 8){
+        xxtea_encode8(v, k);
+        return;
+    }
+#endif
     htonlp(v ,n);
     rounds = 6 + 52/n;
     sum = 0;
@@ -83,6 +191,17 @@ void xxtea_decode_words(uint32_t *v, int n, uint32_t const k[4])
     //if(k[0] == 0 && k[1] == 0 && k[2] == 0 && k[3] == 0) return;
     uint32_t y, z, sum;
     unsigned p, rounds, e;
+
+#ifndef XXTEA_GENERIC_ONLY
+    if(n == 4){
+        xxtea_decode4(v, k);
+        return;
+    }
+    if(n == 8){
+        xxtea_decode8(v, k);
+        return;
+    }
+#endif
     htonlp(v ,n);
 
     rounds = 6 + 52/n;
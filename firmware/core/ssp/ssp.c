@@ -68,12 +68,16 @@
 /**************************************************************************/
 #include "ssp.h"
 #include "core/gpio/gpio.h"
+#include <stddef.h>
 
 /* Statistics for all interrupts */
 volatile uint32_t interruptRxStat = 0;
 volatile uint32_t interruptOverRunStat = 0;
 volatile uint32_t interruptRxTimeoutStat = 0;
 
+/* Frames moved by the bulk transfer functions */
+volatile uint32_t sspFrames = 0;
+
 /**************************************************************************/
 /*! 
     @brief SSP0 interrupt handler for SPI communication
@@ -226,10 +230,57 @@ void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phas
   return;
 }
 
+/**************************************************************************/
+/*! 
+    @brief Pipelined SSP0 transfer
+
+    Keeps the TX FIFO topped up while draining the RX FIFO, so the bus
+    does not idle between frames. At most SSP_FIFOSIZE frames are in
+    flight, which guarantees the RX FIFO can not overrun. When tx is
+    NULL all ones are clocked out, when rx is NULL the answer is
+    discarded. tx and rx may point to the same buffer. With wide set
+    the buffers hold uint16_t frames (frame size above 8 bit),
+    otherwise uint8_t.
+*/
+/**************************************************************************/
+static inline void ssp0Transfer(const void *tx, void *rx, uint32_t length,
+                                uint8_t wide)
+{
+  uint32_t sent = 0, rcvd = 0;
+  uint16_t frame;
+
+  sspFrames += length;
+  while (rcvd < length)
+  {
+    while (sent < length && sent - rcvd < SSP_FIFOSIZE &&
+           (SSP_SSP0SR & SSP_SSP0SR_TNF_NOTFULL))
+    {
+      if (!tx)
+        SSP_SSP0DR = 0xFFFF;
+      else if (wide)
+        SSP_SSP0DR = ((const uint16_t *)tx)[sent];
+      else
+        SSP_SSP0DR = ((const uint8_t *)tx)[sent];
+      sent++;
+    }
+    while (rcvd < sent && (SSP_SSP0SR & SSP_SSP0SR_RNE_NOTEMPTY))
+    {
+      frame = SSP_SSP0DR;
+      if (rx && wide)
+        ((uint16_t *)rx)[rcvd] = frame;
+      else if (rx)
+        ((uint8_t *)rx)[rcvd] = frame;
+      rcvd++;
+    }
+  }
+}
+
 /**************************************************************************/
 /*! 
     @brief Sends a block of data to the SSP0 port
 
+    Write-only: the received bytes are discarded as they arrive.
+
     @param[in]  portNum
                 The SPI port to use (0..1)
     @param[in]  buf
@@ -240,24 +291,34 @@ void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phas
 /**************************************************************************/
 void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length)
 {
-  uint32_t i;
-  uint8_t Dummy = Dummy;
+  if (portNum == 0)
+  {
+    ssp0Transfer(buf, NULL, length, 0);
+  }
+
+  return; 
+}
+
+/**************************************************************************/
+/*! 
+    @brief Sends a block of 16-bit frames to the SSP0 port
+
+    Same as sspSend(), for frame sizes above 8 bit (e.g. the 9-bit
+    frames of the LCD). The frame size must be set up by the caller.
 
+    @param[in]  portNum
+                The SPI port to use (0..1)
+    @param[in]  buf
+                Pointer to the frames
+    @param[in]  length
+                Number of frames
+*/
+/**************************************************************************/
+void sspSend16 (uint8_t portNum, const uint16_t *buf, uint32_t length)
+{
   if (portNum == 0)
   {
-    for (i = 0; i < length; i++)
-    {
-      /* Move on only if NOT busy and TX FIFO not full. */
-      while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_NOTFULL | SSP_SSP0SR_BSY_BUSY)) != SSP_SSP0SR_TNF_NOTFULL);
-      SSP_SSP0DR = *buf;
-      buf++;
-  
-      while ( (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY );
-      /* Whenever a byte is written, MISO FIFO counter increments, Clear FIFO 
-      on MISO. Otherwise, when SSP0Receive() is called, previous data byte
-      is left in the FIFO. */
-      Dummy = SSP_SSP0DR;
-    }
+    ssp0Transfer(buf, NULL, length, 1);
   }
 
   return; 
@@ -277,21 +338,9 @@ void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length)
 /**************************************************************************/
 void sspReceive(uint8_t portNum, uint8_t *buf, uint32_t length)
 {
-  uint32_t i;
-
   if (portNum == 0)
   {
-    for ( i = 0; i < length; i++ )
-    {
-      /* As long as the receive FIFO is not empty, data can be received. */
-      SSP_SSP0DR = 0xFF;
-  
-      /* Wait until the Busy bit is cleared */
-      while ( (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY );
-      
-      *buf = SSP_SSP0DR;
-      buf++;
-    }
+    ssp0Transfer(NULL, buf, length, 0);
   }
 
   return; 
@@ -313,26 +362,10 @@ void sspReceive(uint8_t portNum, uint8_t *buf, uint32_t length)
 /**************************************************************************/
 void sspSendReceive(uint8_t portNum, uint8_t *buf, uint32_t length)
 {
-  uint32_t i;
-  uint8_t Dummy = Dummy;
-
   if (portNum == 0)
   {
-    for (i = 0; i < length; i++)
-    {
-      /* Move on only if NOT busy and TX FIFO not full. */
-      while ((SSP_SSP0SR & (SSP_SSP0SR_TNF_NOTFULL | SSP_SSP0SR_BSY_BUSY)) != SSP_SSP0SR_TNF_NOTFULL);
-      SSP_SSP0DR = *buf;
-  
-      while ( (SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY );
-      /* Whenever a byte is written, MISO FIFO counter increments, Clear FIFO 
-      on MISO. Otherwise, when SSP0Receive() is called, previous data byte
-      is left in the FIFO. */
-      *buf = SSP_SSP0DR;
-      buf++;
-    }
+    ssp0Transfer(buf, buf, length, 0);
   }
 
   return; 
 }
-
@@ -77,9 +77,12 @@ typedef enum sspClockPhase_e
 } 
 sspClockPhase_t;
 
+extern volatile uint32_t sspFrames;
+
 extern void SSP_IRQHandler (void);
 void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phase);
 void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length);
+void sspSend16 (uint8_t portNum, const uint16_t *buf, uint32_t length);
 void sspReceive (uint8_t portNum, uint8_t *buf, uint32_t length);
 void sspSendReceive(uint8_t portNum, uint8_t *buf, uint32_t length);
 #endif
@@ -1,5 +1,6 @@
 #include "projectconfig.h"
 #include "diskio.h"
+#include "at45db041d.h"
 #include "iobase.h"
 #include "core/ssp/ssp.h"
 #include "basic/basic.h"
@@ -8,6 +9,7 @@
 #define OP_POWERDOWN      (0xB9)
 #define OP_RESUME         (0xAB)
 #define OP_PAGEREAD       (0xD2)
+#define OP_CONTREAD       (0x03) /* Low Frequency (<=33MHz) */
 #define OP_BUFFER1READ    (0xD1) /* Low Frequency (<=33MHz) */
 #define OP_BUFFER2READ    (0xD3) /* Low Frequency (<=33MHz) */
 #define OP_BUFFER1WRITE   (0x84)
@@ -29,23 +31,113 @@
 #define SB_PAGESIZE       (1 << 0)
 
 #define MAX_PAGE          (2048)
+#define PAGE_EXTRA        (8)    /* a page has 264 bytes, only 256 are used */
 
-#define CS_LOW()    gpioSetValue(RB_SPI_CS_DF, 0)
-#define CS_HIGH()   gpioSetValue(RB_SPI_CS_DF, 1)
+#define CS_LOW()    do{ sspbusAcquire(SSPBUS_DF); \
+                        gpioSetValue(RB_SPI_CS_DF, 0); }while(0)
+#define CS_HIGH()   do{ gpioSetValue(RB_SPI_CS_DF, 1); \
+                        sspbusRelease(SSPBUS_DF); }while(0)
 
 static volatile DSTATUS status = STA_NOINIT;
 
-static void wait_for_ready() {
-    BYTE reg_status = 0xFF;
+/* Address bits of the byte in a page: 9 for 264 byte pages, 8 if the
+ * chip is configured for the binary (256 byte) page size. */
+static BYTE page_shift = 9;
+
+static BYTE read_status() {
+    BYTE reg_status;
 
     CS_LOW();
     xmit_spi(OP_STATUSREAD);
-    do {
-        rcvr_spi_m((uint8_t *) &reg_status);
-    } while (!(reg_status & SB_READY));
+    rcvr_spi_m((uint8_t *) &reg_status);
+    CS_HIGH();
+    return reg_status;
+}
+
+/* One transaction per poll: page programs take milliseconds, the radio
+ * and the LCD get the bus in between. */
+static BYTE wait_for_ready() {
+    BYTE reg_status;
+
+    while (!((reg_status = read_status()) & SB_READY))
+        ;
+    return reg_status;
+}
+
+static void dataflash_cmd(BYTE op, DWORD addr) {
+    BYTE cmd[4] = { op, (BYTE)(addr >> 16), (BYTE)(addr >> 8), (BYTE)addr };
+
+    CS_LOW();
+    sspSend(0, cmd, sizeof(cmd));
     CS_HIGH();
 }
 
+#if _READONLY == 0
+/* The two SRAM buffers are used in turn: while one is programmed into
+ * its page the next page is already written into the other one. Only
+ * operations on the main memory (page to buffer, compare, program) have
+ * to wait for the previous program to finish.
+ *
+ * The compare and program of the last page written are left pending.
+ * A work queue job issues them as soon as the chip is ready, every
+ * other access finishes them first (df_finish), waiting only if it has
+ * to. The program itself is never waited for until the chip is needed
+ * again.
+ */
+static const struct {
+    BYTE load, write, cmp, prog;
+} df_buffer[2] = {
+    { OP_PAGE2BUFFER1, OP_BUFFER1WRITE, OP_BUFFER1PAGECMP, OP_BUFFER1PROG },
+    { OP_PAGE2BUFFER2, OP_BUFFER2WRITE, OP_BUFFER2PAGECMP, OP_BUFFER2PROG },
+};
+static BYTE df_next = 0;
+
+#define DF_IDLE     0
+#define DF_COMPARE  1   /* buffer written, compare with its page */
+#define DF_PROGRAM  2   /* compare running, program if it differs */
+
+static struct {
+    DWORD pageaddr;
+    BYTE buffer;
+    BYTE state;
+    BYTE queued;
+} df_pending;
+
+/* Advance the pending page without waiting, 1 once it is done */
+static int df_step() {
+    BYTE reg_status;
+
+    if (df_pending.state == DF_IDLE)
+        return 1;
+    reg_status = read_status();
+    if (!(reg_status & SB_READY))
+        return 0;
+    if (df_pending.state == DF_COMPARE) {
+        dataflash_cmd(df_buffer[df_pending.buffer].cmp, df_pending.pageaddr);
+        df_pending.state = DF_PROGRAM;
+        return 0;
+    }
+    if (reg_status & SB_COMP)
+        dataflash_cmd(df_buffer[df_pending.buffer].prog, df_pending.pageaddr);
+    df_pending.state = DF_IDLE;
+    return 1;
+}
+
+static void df_finish() {
+    while (!df_step())
+        ;
+}
+
+static uint8_t df_job(uint8_t state) {
+    if (!df_step())
+        return 1;
+    df_pending.queued = 0;
+    return QS_END;
+}
+#else
+#define df_finish() do{}while(0)
+#endif /* _READONLY */
+
 static void dataflash_powerdown() {
     CS_LOW();
     xmit_spi(OP_POWERDOWN);
@@ -64,6 +156,8 @@ DSTATUS dataflash_initialize() {
     gpioSetDir(RB_SPI_CS_DF, gpioDirection_Output);
 
     dataflash_resume();
+    if (wait_for_ready() & SB_PAGESIZE)
+        page_shift = 8;
     status &= ~STA_NOINIT;
     return status;
 }
@@ -77,9 +171,42 @@ DRESULT dataflash_random_read(BYTE *buff, DWORD offset, DWORD length) {
     if (status & STA_NOINIT) return RES_NOTRDY;
     if (offset+length > MAX_PAGE*256) return RES_PARERR;
 
+    df_finish();
+#if DF_CONTREAD
+    // one command for the whole range, the chip moves on to the
+    // next page by itself
+    DWORD pageaddr = ((offset/256) << page_shift) | (offset%256);
+    DWORD remaining = 256 - offset%256;
+    BYTE cmd[4] = { OP_CONTREAD, (BYTE)(pageaddr >> 16),
+        (BYTE)(pageaddr >> 8), (BYTE)pageaddr };
+
+    wait_for_ready();
+    CS_LOW();
+    sspSend(0, cmd, sizeof(cmd));
+    if (page_shift == 8) {
+        sspReceive(0, buff, length);
+        length = 0;
+    } else {
+        BYTE extra[PAGE_EXTRA];
+        while (1) {
+            if (remaining > length) {
+                remaining = length;
+            }
+            sspReceive(0, buff, remaining);
+            buff += remaining;
+            length -= remaining;
+            if (!length)
+                break;
+            // skip the unused end of the page
+            sspReceive(0, extra, sizeof(extra));
+            remaining = 256;
+        }
+    }
+    CS_HIGH();
+#else
     do {
         wait_for_ready();
-        DWORD pageaddr = ((offset/256) << 9) | (offset%256);
+        DWORD pageaddr = ((offset/256) << page_shift) | (offset%256);
         DWORD remaining = 256 - offset%256;
         if (remaining > length) {
             remaining = length;
@@ -87,20 +214,17 @@ DRESULT dataflash_random_read(BYTE *buff, DWORD offset, DWORD length) {
         length -= remaining;
         offset += remaining;
 
+        // opcode, address, 4 don't care bytes
+        BYTE cmd[8] = { OP_PAGEREAD, (BYTE)(pageaddr >> 16),
+            (BYTE)(pageaddr >> 8), (BYTE)pageaddr, 0, 0, 0, 0 };
+
         CS_LOW();
-        xmit_spi(OP_PAGEREAD);
-        xmit_spi((BYTE)(pageaddr >> 16));
-        xmit_spi((BYTE)(pageaddr >> 8));
-        xmit_spi((BYTE)pageaddr);
-        xmit_spi(0x00); // follow up with 4 don't care bytes
-        xmit_spi(0x00);
-        xmit_spi(0x00);
-        xmit_spi(0x00);
-        do {
-            rcvr_spi_m(buff++);
-        } while (--remaining);
+        sspSend(0, cmd, sizeof(cmd));
+        sspReceive(0, buff, remaining);
+        buff += remaining;
         CS_HIGH();
     } while (length);
+#endif
 
     return length ? RES_ERROR : RES_OK;
 }
@@ -110,14 +234,15 @@ DRESULT dataflash_read(BYTE *buff, DWORD sector, BYTE count) {
 }
 
 #if _READONLY == 0
-DRESULT dataflash_random_write(const BYTE *buff, DWORD offset, DWORD length) {
+static DRESULT df_write(const BYTE *buff, DWORD offset, DWORD length,
+        BYTE async) {
     if (!length) return RES_PARERR;
     if (status & STA_NOINIT) return RES_NOTRDY;
     if (offset+length > MAX_PAGE*256) return RES_PARERR;
 
     do {
-        wait_for_ready();
-        DWORD pageaddr = (offset/256) << 9;
+        BYTE b = df_next;
+        DWORD pageaddr = (offset/256) << page_shift;
         DWORD buffaddr = (offset%256);
         DWORD remaining = 256 - offset%256;
         if (remaining > length) {
@@ -125,58 +250,57 @@ DRESULT dataflash_random_write(const BYTE *buff, DWORD offset, DWORD length) {
         }
         length -= remaining;
         offset += remaining;
-
-        // read page into the internal buffer
-        CS_LOW();
-        xmit_spi(OP_PAGE2BUFFER1);
-        xmit_spi((BYTE)(pageaddr >> 16));
-        xmit_spi((BYTE)(pageaddr >> 8));
-        xmit_spi((BYTE)pageaddr);
-        CS_HIGH();
+#if DF_PINGPONG
+        df_next ^= 1;
+
+        // start the previous page (in the other buffer): this waits
+        // for the program before it, which came from this buffer
+        df_finish();
+#else
+        df_finish();
         wait_for_ready();
+#endif
 
-        // write bytes into the dataflash buffer
-        CS_LOW();
-        xmit_spi(OP_BUFFER1WRITE);
-        xmit_spi((BYTE)(buffaddr >> 16));
-        xmit_spi((BYTE)(buffaddr >> 8));
-        xmit_spi((BYTE)buffaddr);
-        do {
-            xmit_spi(*buff++);
-        } while (--remaining);
-        CS_HIGH();
-        wait_for_ready();
+        // partial page: read the rest of it into the buffer first
+        if (remaining < 256) {
+            wait_for_ready();
+            dataflash_cmd(df_buffer[b].load, pageaddr);
+            wait_for_ready();
+        }
+
+        // write bytes into the dataflash buffer, this may overlap
+        // with programming the other one
+        BYTE cmd[4] = { df_buffer[b].write, (BYTE)(buffaddr >> 16),
+            (BYTE)(buffaddr >> 8), (BYTE)buffaddr };
 
-        // compare buffer with target memory page
-        CS_LOW();
-        xmit_spi(OP_BUFFER1PAGECMP);
-        xmit_spi((BYTE)(pageaddr >> 16));
-        xmit_spi((BYTE)(pageaddr >> 8));
-        xmit_spi((BYTE)pageaddr);
-        CS_HIGH();
-        wait_for_ready();
         CS_LOW();
-        BYTE reg_status = 0xFF;
-        xmit_spi(OP_STATUSREAD);
-        rcvr_spi_m((uint8_t *) &reg_status);
+        sspSend(0, cmd, sizeof(cmd));
+        sspSend(0, buff, remaining);
+        buff += remaining;
         CS_HIGH();
 
-        // trigger program only if data changed
-        if (reg_status & SB_COMP) {
-            CS_LOW();
-            xmit_spi(OP_BUFFER1PROG);
-            xmit_spi((BYTE)(pageaddr >> 16));
-            xmit_spi((BYTE)(pageaddr >> 8));
-            xmit_spi((BYTE)pageaddr);
-            CS_HIGH();
-        }
+        // compare and program once the previous page is out
+        df_pending.pageaddr = pageaddr;
+        df_pending.buffer = b;
+        df_pending.state = DF_COMPARE;
     } while (length);
 
+    if (!async)
+        df_finish();
+    else if (!df_pending.queued && push_queue_plus(&df_job) == 0)
+        df_pending.queued = 1;
+
     return length ? RES_ERROR : RES_OK;
 }
 
+/* Also called by USB mass storage from interrupt context, so the last
+ * page is not left to the work queue. */
+DRESULT dataflash_random_write(const BYTE *buff, DWORD offset, DWORD length) {
+    return df_write(buff, offset, length, 0);
+}
+
 DRESULT dataflash_write(const BYTE *buff, DWORD sector, BYTE count) {
-    return dataflash_random_write(buff, sector*512, count*512);
+    return df_write(buff, sector*512, count*512, 1);
 }
 #endif /* _READONLY */
 
@@ -191,6 +315,8 @@ DRESULT dataflash_ioctl(BYTE ctrl, void *buff) {
     if (ctrl == CTRL_POWER) {
         switch (*ptr) {
             case 0: /* Sub control code == 0 (POWER_OFF) */
+                df_finish();
+                wait_for_ready(); /* a page may still be programming */
                 dataflash_powerdown();
                 res = RES_OK;
                 break;
@@ -211,7 +337,9 @@ DRESULT dataflash_ioctl(BYTE ctrl, void *buff) {
 
         switch (ctrl) {
             case CTRL_SYNC:
-                wait_for_ready();
+                /* the last page may still be programming, every
+                 * command that needs the array waits for it */
+                df_finish();
                 res = RES_OK;
                 break;
             case GET_SECTOR_COUNT:
@@ -3,6 +3,20 @@
 
 #include "diskio.h"
 
+/* dataflash_random_read() streams a range with a single continuous
+ * array read. DF_CONTREAD=0 selects the old read, one page read
+ * command per page, e.g. to compare against (tools/dataflash). */
+#ifndef DF_CONTREAD
+#define DF_CONTREAD 1
+#endif
+
+/* Page writes alternate between the two SRAM buffers. DF_PINGPONG=0
+ * uses buffer 1 only and waits for each program before the next page,
+ * like the old write. */
+#ifndef DF_PINGPONG
+#define DF_PINGPONG 1
+#endif
+
 DSTATUS dataflash_initialize();
 DSTATUS dataflash_status();
 DRESULT dataflash_read(BYTE *buff, DWORD sector, BYTE count);
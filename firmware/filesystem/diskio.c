@@ -1,7 +1,161 @@
+#include <string.h>
 #include "projectconfig.h"
 #include "diskio.h"
 #include "mmc.h"
 #include "at45db041d.h"
+#include "extent.h"
+
+/* sector cache, dataflash only */
+
+#define SECTOR 512
+
+struct diskcache_stats diskcacheStats;
+static void (*dc_drophook)(void);
+
+void diskcacheDropHook(void (*fn)(void)) {
+    dc_drophook = fn;
+}
+
+#if DISKCACHE_SECTORS > 0
+static struct {
+    DWORD sector;
+    DWORD used;         /* dc_clock at the last access */
+    BYTE valid;
+    BYTE dirty;
+} dc_tag[DISKCACHE_SECTORS];
+static BYTE dc_data[DISKCACHE_SECTORS][SECTOR];
+static DWORD dc_clock;
+
+static int dc_find(DWORD sector) {
+    for (int i = 0; i < DISKCACHE_SECTORS; i++)
+        if (dc_tag[i].valid && dc_tag[i].sector == sector) {
+            dc_tag[i].used = ++dc_clock;
+            return i;
+        }
+    return -1;
+}
+
+static DRESULT dc_writeback(int i) {
+    DRESULT res;
+
+    if (!dc_tag[i].valid || !dc_tag[i].dirty)
+        return RES_OK;
+    res = dataflash_write(dc_data[i], dc_tag[i].sector, 1);
+    if (res == RES_OK) {
+        dc_tag[i].dirty = 0;
+        diskcacheStats.writebacks++;
+    }
+    return res;
+}
+
+/* slot for a sector that is not cached: a free or the least recently
+ * used one */
+static int dc_alloc(DWORD sector) {
+    int i, lru = 0;
+
+    for (i = 0; i < DISKCACHE_SECTORS; i++) {
+        if (!dc_tag[i].valid) {
+            lru = i;
+            break;
+        }
+        if (dc_tag[i].used < dc_tag[lru].used)
+            lru = i;
+    }
+    if (dc_writeback(lru) != RES_OK)
+        return -1;
+    dc_tag[lru].sector = sector;
+    dc_tag[lru].valid = 0;
+    dc_tag[lru].used = ++dc_clock;
+    return lru;
+}
+
+static DRESULT dc_flush(void) {
+    DRESULT res = RES_OK;
+
+    for (int i = 0; i < DISKCACHE_SECTORS; i++)
+        if (dc_writeback(i) != RES_OK)
+            res = RES_ERROR;
+    return res;
+}
+
+static DRESULT dc_read(BYTE *buff, DWORD sector, BYTE count) {
+    DRESULT res;
+    int i;
+
+    if (count == 1) {
+        i = dc_find(sector);
+        if (i >= 0) {
+            diskcacheStats.hits++;
+        } else {
+            diskcacheStats.misses++;
+            if ((i = dc_alloc(sector)) < 0)
+                return RES_ERROR;
+            res = dataflash_read(dc_data[i], sector, 1);
+            if (res != RES_OK)
+                return res;
+            dc_tag[i].valid = 1;
+            dc_tag[i].dirty = 0;
+        }
+        memcpy(buff, dc_data[i], SECTOR);
+        return RES_OK;
+    }
+
+    /* bulk data: read around the cache, newer cached sectors win */
+    res = dataflash_read(buff, sector, count);
+    if (res != RES_OK)
+        return res;
+    for (i = 0; i < DISKCACHE_SECTORS; i++)
+        if (dc_tag[i].valid && dc_tag[i].dirty
+                && dc_tag[i].sector - sector < count)
+            memcpy(buff + (dc_tag[i].sector - sector) * SECTOR,
+                    dc_data[i], SECTOR);
+    return RES_OK;
+}
+
+#if _READONLY == 0
+static DRESULT dc_write(const BYTE *buff, DWORD sector, BYTE count) {
+    int i;
+
+    if (count == 1) {
+        i = dc_find(sector);
+        if (i < 0 && (i = dc_alloc(sector)) < 0)
+            return RES_ERROR;
+        memcpy(dc_data[i], buff, SECTOR);
+        dc_tag[i].valid = 1;
+        dc_tag[i].dirty = 1;
+        return RES_OK;
+    }
+
+    /* bulk data: write through, cached copies are stale now */
+    for (i = 0; i < DISKCACHE_SECTORS; i++)
+        if (dc_tag[i].valid && dc_tag[i].sector - sector < count)
+            dc_tag[i].valid = 0;
+    return dataflash_write(buff, sector, count);
+}
+#endif /* _READONLY == 0 */
+
+void diskcacheDrop(void) {
+    extentInvalidate();
+    if (dc_drophook)
+        dc_drophook();
+    dc_flush();
+    dataflash_ioctl(CTRL_SYNC, NULL);
+    for (int i = 0; i < DISKCACHE_SECTORS; i++)
+        dc_tag[i].valid = 0;
+}
+
+#else /* DISKCACHE_SECTORS == 0 */
+#define dc_read  dataflash_read
+#define dc_write dataflash_write
+#define dc_flush() RES_OK
+
+void diskcacheDrop(void) {
+    extentInvalidate();
+    if (dc_drophook)
+        dc_drophook();
+    dataflash_ioctl(CTRL_SYNC, NULL);
+}
+#endif /* DISKCACHE_SECTORS */
 
 /* diskio interface */
 
@@ -40,7 +194,7 @@ DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count) {
     switch (drv) {
         case 0:
     #endif
-            return dataflash_read(buff, sector, count);
+            return dc_read(buff, sector, count);
     #if CFG_HAVE_SDCARD == 1
         case 1:
             return mmc_read(buff, sector, count);
@@ -56,7 +210,8 @@ DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count) {
     switch (drv) {
         case 0:
     #endif
-            return dataflash_write(buff, sector, count);
+            extentWritten(buff, sector, count);
+            return dc_write(buff, sector, count);
     #if CFG_HAVE_SDCARD == 1
         case 1:
             return mmc_write(buff, sector, count);
@@ -73,6 +228,11 @@ DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff) {
     switch (drv) {
         case 0:
     #endif
+            if (ctrl == CTRL_SYNC
+                    || (ctrl == CTRL_POWER && *(BYTE*)buff == 0)) {
+                if (dc_flush() != RES_OK)
+                    return RES_ERROR;
+            }
             return dataflash_ioctl(ctrl, buff);
     #if CFG_HAVE_SDCARD == 1
         case 1:
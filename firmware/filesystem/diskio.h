@@ -35,6 +35,27 @@ DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 #endif
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 
+/* Single sector reads and writes of the dataflash (drive 0) go through
+ * a small write-back LRU cache of DISKCACHE_SECTORS (512 bytes of RAM
+ * each), flushed on CTRL_SYNC and power off. It is off unless the
+ * build sets DISKCACHE_SECTORS, e.g. to 2. Anything that writes the flash
+ * behind FatFs' back (USB mass storage) calls diskcacheDrop() first,
+ * which also finishes pending dataflash writes, drops the file extents
+ * (extent.h) and calls the hook set with diskcacheDropHook(), so that
+ * users above FatFs (the font renderer) can forget what they read. */
+#ifndef DISKCACHE_SECTORS
+#define DISKCACHE_SECTORS 0
+#endif
+
+struct diskcache_stats {
+	DWORD hits;
+	DWORD misses;
+	DWORD writebacks;
+};
+extern struct diskcache_stats diskcacheStats;
+void diskcacheDrop (void);
+void diskcacheDropHook (void (*fn)(void));
+
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -4,10 +4,13 @@
 #include "basic/basic.h"
 
 #include "lcd/print.h"
+#include "lcd/display.h"
 
 #include "usb/usbmsc.h"
 
 #include "filesystem/ff.h"
+#include "filesystem/extent.h"
+#include "filesystem/at45db041d.h"
 #include "filesystem/select.h"
 
 #include "basic/xxtea.h"
@@ -22,6 +25,7 @@ uint8_t execute_file (const char * fname){
     FRESULT res;
     FIL file;
     UINT readbytes;
+    EXTENT ext;
     void (*dst)(void);
 
     /* XXX: why doesn't this work? sram_top contains garbage?
@@ -30,21 +34,28 @@ uint8_t execute_file (const char * fname){
     */
     dst=(void (*)(void)) (0x10002000 - RAMCODE);
 
-    res=f_open(&file, fname, FA_OPEN_EXISTING|FA_READ);
-
-    //lcdPrint("open: ");
-    //lcdPrintln(f_get_rc_string(res));
-    //lcdRefresh();
-    if(res){
-        return -1;
-    };
-    
-    res = f_read(&file, (char *)dst, RAMCODE, &readbytes);
-    //lcdPrint("read: ");
-    //lcdPrintln(f_get_rc_string(res));
-    //lcdRefresh();
-    if(res){
-        return -1;
+    /* contiguous files come straight from the flash */
+    if(fileExtent(fname,&ext)==0){
+        readbytes=ext.size<RAMCODE?ext.size:RAMCODE;
+        if(!readbytes || dataflash_random_read((BYTE *)dst, ext.offset, readbytes))
+            return -1;
+    }else{
+        res=f_open(&file, fname, FA_OPEN_EXISTING|FA_READ);
+
+        //lcdPrint("open: ");
+        //lcdPrintln(f_get_rc_string(res));
+        //lcdRefresh();
+        if(res){
+            return -1;
+        };
+
+        res = f_read(&file, (char *)dst, RAMCODE, &readbytes);
+        //lcdPrint("read: ");
+        //lcdPrintln(f_get_rc_string(res));
+        //lcdRefresh();
+        if(res){
+            return -1;
+        };
     };
 #ifdef ENCRYPT_L0DABLE
     uint32_t *data;
@@ -83,6 +94,7 @@ uint8_t execute_file (const char * fname){
 
     dst=(void (*)(void)) ((uint32_t)(dst) | 1); // Enable Thumb mode!
     dst();
+    lcdSetFrontBuffer(NULL); // it lived in the l0dable's memory
     return 0;
 
 }
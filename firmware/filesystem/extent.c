@@ -0,0 +1,201 @@
+#include <string.h>
+#include "ff.h"
+#include "diskio.h"
+#include "extent.h"
+
+/* ff.c */
+DWORD clust2sect(FATFS *fs, DWORD clst);
+DWORD get_fat(FATFS *fs, DWORD clst);
+
+#define SECTOR 512
+
+static struct {
+    BYTE sfn[11];       /* directory name, sfn[0]==0 if unused */
+    BYTE contiguous;
+    BYTE dirent;        /* index of the entry in dirsect */
+    DWORD dirsect;      /* sector holding the directory entry */
+    DWORD sclust;       /* first cluster */
+    DWORD nclust;       /* clusters that must follow each other */
+    DWORD used;         /* ext_clock at the last lookup */
+    EXTENT ext;
+} ext_tab[EXTENT_ENTRIES];
+static DWORD ext_clock;
+static FATFS *ext_fs;   /* the entries belong to */
+
+void extentInvalidate(void) {
+    for (int i = 0; i < EXTENT_ENTRIES; i++)
+        ext_tab[i].sfn[0] = 0;
+}
+
+/* "name.ext" as it is stored in the directory, 0 if it is no 8.3 name */
+static int ext_sfn(const char *fname, BYTE *sfn) {
+    int i = 0, end = 8;
+    char c;
+
+    memset(sfn, ' ', 11);
+    while ((c = *fname++)) {
+        if (c == '.' && end == 8) {
+            i = 8;
+            end = 11;
+            continue;
+        }
+        if (i >= end || c == '.' || c == '/' || c == '\\' || c == ' ')
+            return 0;
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        sfn[i++] = c;
+    }
+    return sfn[0] != ' ';
+}
+
+/* Look the file up, with sfn the result is remembered in slot */
+static int ext_resolve(const char *fname, EXTENT *ext,
+        const BYTE *sfn, int slot) {
+    FIL file;
+    DWORD clst, next, n, csize;
+
+    if (f_open(&file, fname, FA_OPEN_EXISTING|FA_READ) != FR_OK)
+        return -1;
+    if (sfn) {
+        // the entry is in the window only until the chain is walked
+        if (file.fs != ext_fs) {
+            extentInvalidate();
+            ext_fs = file.fs;
+        }
+        if (!memcmp(file.dir_ptr, sfn, 11))
+            memcpy(ext_tab[slot].sfn, sfn, 11);
+        ext_tab[slot].dirsect = file.dir_sect;
+        ext_tab[slot].dirent = (file.dir_ptr - file.fs->win) / 32;
+        ext_tab[slot].sclust = file.sclust;
+    }
+    ext->size = file.fsize;
+    clst = file.sclust;
+    n = 2;
+    if (clst) {
+        // follow the chain as long as it goes on with the next cluster
+        csize = file.fs->csize * 512UL;
+        for (n = (file.fsize + csize - 1) / csize; n > 1; n--) {
+            next = get_fat(file.fs, clst);
+            if (next != clst + 1)
+                break;
+            clst = next;
+        }
+        ext->offset = clust2sect(file.fs, file.sclust) * 512UL;
+        if (sfn)
+            ext_tab[slot].nclust = clst - file.sclust + 1;
+    }
+    f_close(&file);
+    return n > 1;
+}
+
+int fileExtent(const char *fname, EXTENT *ext) {
+    int i, lru = 0, res;
+    BYTE sfn[11];
+
+    if (!ext_sfn(fname, sfn)) {
+        disk_ioctl(0, CTRL_SYNC, NULL);
+        return ext_resolve(fname, ext, NULL, 0);
+    }
+
+    for (i = 0; i < EXTENT_ENTRIES; i++)
+        if (ext_tab[i].sfn[0] && !memcmp(ext_tab[i].sfn, sfn, 11)) {
+            ext_tab[i].used = ++ext_clock;
+            *ext = ext_tab[i].ext;
+            return !ext_tab[i].contiguous;
+        }
+
+    for (i = 0; i < EXTENT_ENTRIES; i++) {
+        if (!ext_tab[i].sfn[0]) {
+            lru = i;
+            break;
+        }
+        if (ext_tab[i].used < ext_tab[lru].used)
+            lru = i;
+    }
+
+    // raw reads bypass the sector cache, nothing may be left in there.
+    // Writes to the file's sectors drop the entry again.
+    disk_ioctl(0, CTRL_SYNC, NULL);
+    ext_tab[lru].sfn[0] = 0;
+    ext_tab[lru].nclust = 0;
+    res = ext_resolve(fname, ext, sfn, lru);
+    if (res < 0)
+        return res;
+    ext_tab[lru].contiguous = !res;
+    ext_tab[lru].used = ++ext_clock;
+    ext_tab[lru].ext = *ext;
+    return res;
+}
+
+/* Does the FAT sector at byte offset base still link cluster k to k+1?
+ * Only the bytes of the entry that lie in this sector are checked. */
+static int ext_linked(const BYTE *buf, DWORD base, DWORD k) {
+    DWORD o, v = k + 1, mask;
+    int i, len;
+
+    switch (ext_fs->fs_type) {
+        case FS_FAT12:
+            o = k + k / 2;
+            len = 2;
+            if (k & 1) {
+                v <<= 4;
+                mask = 0xFFF0;
+            } else
+                mask = 0x0FFF;
+            break;
+        case FS_FAT16:
+            o = k * 2;
+            len = 2;
+            mask = 0xFFFF;
+            break;
+        default:
+            o = k * 4;
+            len = 4;
+            mask = 0x0FFFFFFF;
+    }
+    for (i = 0; i < len; i++, v >>= 8, mask >>= 8)
+        if (o + i >= base && o + i < base + SECTOR
+                && ((buf[o + i - base] ^ v) & mask & 0xFF))
+            return 0;
+    return 1;
+}
+
+/* Is the entry still valid after buf was written to sector? */
+static int ext_keep(int i, const BYTE *buf, DWORD sector) {
+    DWORD first, rel, k;
+    const BYTE *dir;
+
+    if (sector < ext_fs->fatbase)
+        return 0;       // boot sector: anything may have moved
+
+    if (sector == ext_tab[i].dirsect) {
+        dir = buf + ext_tab[i].dirent * 32;
+        if (memcmp(dir, ext_tab[i].sfn, 11)
+                || (dir[26] | dir[27] << 8 | (DWORD)dir[20] << 16
+                    | (DWORD)dir[21] << 24) != ext_tab[i].sclust
+                || (dir[28] | dir[29] << 8 | (DWORD)dir[30] << 16
+                    | (DWORD)dir[31] << 24) != ext_tab[i].ext.size)
+            return 0;
+    }
+    if (!ext_tab[i].contiguous || !ext_tab[i].nclust)
+        return 1;       // read through FatFs, only the entry matters
+
+    first = ext_tab[i].ext.offset / SECTOR;
+    if (sector - first < ext_tab[i].nclust * ext_fs->csize)
+        return 0;       // the data itself: may still be in the cache
+
+    if (sector < ext_fs->fatbase + ext_fs->n_fats * ext_fs->fsize) {
+        rel = (sector - ext_fs->fatbase) % ext_fs->fsize * SECTOR;
+        for (k = 0; k + 1 < ext_tab[i].nclust; k++)
+            if (!ext_linked(buf, rel, ext_tab[i].sclust + k))
+                return 0;
+    }
+    return 1;
+}
+
+void extentWritten(const BYTE *buff, DWORD sector, BYTE count) {
+    for (int i = 0; i < EXTENT_ENTRIES; i++)
+        for (BYTE n = 0; n < count && ext_tab[i].sfn[0]; n++)
+            if (!ext_keep(i, buff + n * SECTOR, sector + n))
+                ext_tab[i].sfn[0] = 0;
+}
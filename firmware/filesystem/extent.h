@@ -0,0 +1,26 @@
+#ifndef _EXTENT_H
+#define _EXTENT_H 1
+
+#include "ff.h"
+
+/* Files that lie in consecutive clusters can be read straight from the
+ * dataflash with dataflash_random_read(), without FatFs walking the
+ * cluster chain. fileExtent() looks a file up once and remembers it in
+ * a small table. It returns 0 if the file is contiguous, 1 if it is not
+ * (read it through FatFs), -1 if it can't be opened.
+ * extentWritten() drops the files whose data, directory entry or
+ * cluster chain a disk write changes, extentInvalidate() all of them. */
+#ifndef EXTENT_ENTRIES
+#define EXTENT_ENTRIES 2
+#endif
+
+typedef struct {
+    DWORD offset;   /* byte offset on the dataflash */
+    DWORD size;     /* file size */
+} EXTENT;
+
+int fileExtent(const char *fname, EXTENT *ext);
+void extentInvalidate(void);
+void extentWritten(const BYTE *buff, DWORD sector, BYTE count);
+
+#endif /* _EXTENT_H */
@@ -3,126 +3,168 @@
 #include "filetransfer.h"
 #include "rftransfer.h"
 #include "basic/basic.h"
+#include "basic/byteorder.h"
 #include "basic/xxtea.h"
 #include "filesystem/ff.h"
 #include "lcd/print.h"
 
+/* metadata packet: name[20] size[2] size32[4] chunk[2] crc[2]
+ * size[2] is the size for old receivers (0xffff if it does not fit) */
+
+/* The chunk buffer only lives in these two helpers, so it is not on
+ * the stack while the callers print or open files. */
+static int __attribute__ ((noinline)) ft_send_chunks(FIL *file,
+                uint32_t const k[4])
+{
+    __attribute__ ((aligned (4))) uint8_t buf[FT_CHUNKHDR+FT_CHUNK];
+    FRESULT res;
+    UINT readbytes;
+    uint16_t chunk = 0;
+
+    do {
+        res = f_read(file, (char *)buf+FT_CHUNKHDR, FT_CHUNK, &readbytes);
+        if( res )
+            break;
+        if( readbytes == 0 && chunk > 0 )
+            break;
+
+        uint16_t crc = crc16(buf+FT_CHUNKHDR, readbytes);
+        buf[0] = chunk >> 8;
+        buf[1] = chunk & 0xFF;
+        buf[2] = crc >> 8;
+        buf[3] = crc & 0xFF;
+
+        uint16_t wordcount = (FT_CHUNKHDR+readbytes+3)/4;
+        xxtea_encode_words((uint32_t *)buf, wordcount, k);
+        if( chunk > 0 )
+            delayms(FT_CHUNKGAP);
+        rftransfer_send(wordcount*4, buf);
+        chunk++;
+    } while( readbytes == FT_CHUNK );
+
+    return res;
+}
 
 //TODO: use a proper MAC to sign the message
 int filetransfer_send(uint8_t *filename, uint16_t size,
                 uint8_t *mac, uint32_t const k[4])
 {
-    uint8_t buf[MAXSIZE];
     FIL file;
     FRESULT res;
-    UINT readbytes;
-
+    uint32_t fsize;
 
-    if( size > MAXSIZE )
-        return 1;           //File to big
- 
     res=f_open(&file, (const char*)filename, FA_OPEN_EXISTING|FA_READ);
     if( res )
         return res;
-
-    //res = f_read(&file, (char *)buf, size, &readbytes);
-    for(uint16_t i=0; i<MAXSIZE; i++)
-        buf[i] = 0;
-
-    res = f_read(&file, (char *)buf, MAXSIZE, &readbytes);
-    size = readbytes;
-
-    if( res )
-        return res;
-    if( size != readbytes)
-        return 1;           //Error while reading
-    
-    uint16_t wordcount = (size+3)/4;
-    //uint8_t macbuf[5];
+    fsize = f_size(&file);
 
     uint8_t metadata[32];
+    memset(metadata, 0, sizeof(metadata));
     if( strlen((char*)filename) < 20 )
         strcpy((char*)metadata, (char*)filename);
-    else
+    else{
+        f_close(&file);
         return 1;           //File name too long
+    }
+    size = fsize > 0xffff ? 0xffff : fsize;
     metadata[20] = size >> 8;
     metadata[21] = size & 0xFF;
+    uint32touint8p(fsize, metadata+22);
+    metadata[26] = FT_CHUNK >> 8;
+    metadata[27] = FT_CHUNK & 0xFF;
 
-    //nrf_get_tx_max(5,macbuf);
-
-    //nrf_set_tx_mac(5, mac); 
     nrf_snd_pkt_crc_encr(32, metadata, k); 
     delayms(20);
-    xxtea_encode_words((uint32_t *)buf, wordcount, k);
-    rftransfer_send(wordcount*4, buf);
-    //nrf_set_tx_mac(5, macbuf);
+
+    res = ft_send_chunks(&file, k);
+
+    f_close(&file);
+    return res;
+}
+
+/* returns 0, an FRESULT or one of the FT_E* codes below */
+#define FT_ECHECKSUM  0x100
+#define FT_ETIMEOUT   0x101
+#define FT_ECORRUPT   0x102
+#define FT_ESHORT     0x103
+
+static int __attribute__ ((noinline)) ft_receive_chunks(FIL *file,
+                uint32_t size, uint32_t const k[4])
+{
+    __attribute__ ((aligned (4))) uint8_t buf[FT_CHUNKHDR+FT_CHUNK];
+    uint16_t chunk = 0;
+    UINT written = 0;
+    FRESULT res;
+
+    do {
+        uint16_t len = size > FT_CHUNK ? FT_CHUNK : size;
+        uint16_t wordcount = (FT_CHUNKHDR+len+3)/4;
+
+        int fres = rftransfer_receive(buf, wordcount*4, 1000);
+        if( fres == -1 )
+            return FT_ECHECKSUM;
+        if( fres == -2 )
+            return FT_ETIMEOUT;
+        if( fres != wordcount*4 )
+            return FT_ESHORT;
+
+        xxtea_decode_words((uint32_t *)buf, wordcount, k);
+        if( ((buf[0] << 8) | buf[1]) != chunk ||
+                ((buf[2] << 8) | buf[3]) != crc16(buf+FT_CHUNKHDR, len) )
+            return FT_ECORRUPT;
+
+        res = f_write(file, buf+FT_CHUNKHDR, len, &written);
+        if( res || written != len )
+            return res ? res : 1;   //error while writing
+        size -= len;
+        chunk++;
+    } while( size > 0 );
+
     return 0;
 }
 
 int filetransfer_receive(uint8_t *mac, uint32_t const k[4])
 {
-    uint8_t buf[MAXSIZE+1];
-    uint16_t size;
+    uint32_t size;
     uint8_t n;
 
-    UINT written = 0;
     FIL file;
     FRESULT res;
-    //uint8_t macbuf[5];
-    //nrf_get_rx_max(0,5,macbuf);
 
     uint8_t metadata[32];
 
-    //nrf_set_rx_mac(0, 32, 5, mac);
     n = nrf_rcv_pkt_time_encr(3000, 32, metadata, k);
     if( n != 32 )
         return 1;       //timeout
-    //nrf_set_rx_mac(0, 32, 5, macbuf);
-    //lcdPrintln("got meta"); lcdRefresh();
     metadata[19] = 0; //enforce termination
-    size = (metadata[20] << 8) | metadata[21];
-
-    if( size > MAXSIZE ) {lcdPrintln("too big"); lcdRefresh(); while(1);}
-    if( size > MAXSIZE ) return 1; //file to big
-    //if(fileexists(metadata)) return 1;   //file already exists
-    
-    //lcdPrint("open"); lcdPrintln((const char*)metadata); lcdRefresh();
-    res = f_open(&file, (const char*)metadata, FA_OPEN_ALWAYS|FA_WRITE);
-
-    //lcdPrintln("file opened"); lcdRefresh();
-    //if( res ) {lcdPrintln("res"); lcdPrint(f_get_rc_string(res)); lcdRefresh(); while(1);}
-    if( res ){ lcdPrintln("file error"); lcdRefresh(); while(1);}
-    if( res )
+    size = uint8ptouint32(metadata+22);
+    if( ((metadata[26] << 8) | metadata[27]) != FT_CHUNK )
+        return 1;       //unknown chunking
+
+    res = f_open(&file, (const char*)metadata, FA_CREATE_ALWAYS|FA_WRITE);
+    if( res ){
+        lcdPrintln("file error"); lcdRefresh();
         return res;
-    
-    uint16_t wordcount = (size+3)/4;
-    
-    //nrf_set_rx_mac(0, 32, 5, mac);
-    //lcdPrintln("get file"); lcdRefresh();
-    int fres = rftransfer_receive(buf, wordcount*4, 1000);
-    if( fres == -1 ){
-        lcdPrintln("checksum wrong");
-    }else if( fres == -2 ){
-        lcdPrintln("timeout");
-    }else{
-        //lcdPrintln("got file");
     }
-    lcdRefresh();
-    if( fres < 0 )
-        return 1;
-    //nrf_set_rx_mac(0, 32, 5, macbuf);
-
-    xxtea_decode_words((uint32_t *)buf, wordcount, k);
-    
-    res = f_write(&file, buf, size, &written);
-    f_close(&file);
+
+    int cres = ft_receive_chunks(&file, size, k);
+    if( cres ){
+        if( cres == FT_ECHECKSUM )
+            lcdPrintln("checksum wrong");
+        else if( cres == FT_ETIMEOUT )
+            lcdPrintln("timeout");
+        else if( cres == FT_ECORRUPT )
+            lcdPrintln("chunk corrupt");
+        lcdRefresh();
+        f_close(&file);
+        return cres < FT_ECHECKSUM ? cres : 1;
+    }
+
+    res = f_close(&file);
     if( res )
         return res;
-    if( written != size )
-        return 1;           //error while writing
     lcdClear();
     lcdPrintln("Received"); lcdPrintln((const char*)metadata); lcdRefresh();
 
     return 0;
 }
-
@@ -2,7 +2,11 @@
 #define _FILETRANSFER_H_
 #include <stdint.h>
 
-#define MAXSIZE 1024
+/* Files are sent as a series of rftransfers of at most FT_CHUNK
+ * bytes each, so the file size is only limited by the filesystem. */
+#define FT_CHUNK     512
+#define FT_CHUNKHDR  4   /* chunk number[2], crc16 of the plaintext[2] */
+#define FT_CHUNKGAP  50  /* ms, lets the receiver write the last chunk */
 
 int filetransfer_send(uint8_t *filename, uint16_t size,
                 uint8_t *mac, uint32_t const k[4]);
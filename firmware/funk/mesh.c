@@ -19,6 +19,25 @@ char mesh_mode=0;
 #define MM_ENC  (1<<1)
 MPKT meshbuffer[MESHBUFSIZE];
 
+// Slot index by type, a nibble each (0xf: not present), and last use
+// for eviction. The index is only a hint: slots get freed by just
+// clearing the flags.
+#define MESHTYPES 0x80
+#if MESHBUFSIZE > 15
+#error "meshindex holds slot numbers up to 14"
+#endif
+static uint8_t meshindex[MESHTYPES/2];
+static uint32_t meshused[MESHBUFSIZE];
+
+#define MESHINDEX(type) ((meshindex[(type)/2]>>((type)%2*4))&0xf)
+static void mesh_index_set(uint8_t type, uint8_t slot){
+    uint8_t shift=type%2*4;
+    meshindex[type/2]=(meshindex[type/2]&~(0xf<<shift))|slot<<shift;
+}
+
+// Digest mode: somebody out there wants this slot
+static uint8_t meshwant[MESHBUFSIZE];
+
 #include "SECRETS"
 
 struct NRF_CFG oldconfig;
@@ -35,11 +54,15 @@ static int mesh_gt(char curgen, char newgen){
 void initMesh(void){
     for(int i=0;i<MESHBUFSIZE;i++){
         meshbuffer[i].flags=MF_FREE;
+        meshused[i]=0;
+        meshwant[i]=0;
     };
+    memset(meshindex,0xff,sizeof(meshindex));
     memset(meshbuffer[0].pkt,0,MESHPKTSIZE);
     meshbuffer[0].pkt[0]='T';
     MO_TIME_set(meshbuffer[0].pkt,getSeconds());
     meshbuffer[0].flags=MF_USED;
+    mesh_index_set('T',0);
 }
 
 #define MP_OK     0
@@ -74,26 +97,59 @@ int mesh_sanity(uint8_t * pkt){
        MO_TYPE(pkt)!='E' && 
        MO_TYPE(pkt)!='F' && 
        MO_TYPE(pkt)!='G' && 
-       MO_TYPE(pkt)!='T'
+       MO_TYPE(pkt)!='T' &&
+       MO_TYPE(pkt)!=MESH_DIGEST
             ){
         return MP_IGNORE;
     };
     return MP_OK;
 }
 
-MPKT * meshGetMessage(uint8_t type){
-    int free=-1;
-    for(int i=0;i<MESHBUFSIZE;i++){
-        if ( ((meshbuffer[i].flags&MF_USED)==0) && free<0 )
-            free=i;
+static int mesh_find(uint8_t type){
+    if(type<MESHTYPES){
+        int i=MESHINDEX(type);
+        if(i<MESHBUFSIZE && (meshbuffer[i].flags&MF_USED) &&
+                MO_TYPE(meshbuffer[i].pkt) == type)
+            return i;
+        mesh_index_set(type,0xf);
+        return -1;
+    };
+    for(int i=0;i<MESHBUFSIZE;i++)
         if ( (meshbuffer[i].flags&MF_USED) &&
-                (MO_TYPE(meshbuffer[i].pkt) == type)){
-            free=i;
-            break;
+                (MO_TYPE(meshbuffer[i].pkt) == type))
+            return i;
+    return -1;
+}
+
+// Buffer full: throw out a packet from an old generation,
+// otherwise the least recently used one. Never the [T]ime slot.
+static int mesh_evict(void){
+    int victim=-1;
+    for(int i=1;i<MESHBUFSIZE;i++){
+        if(meshbuffer[i].flags&MF_LOCK)
+            continue;
+        if(MO_GEN(meshbuffer[i].pkt)!=meshgen)
+            return i;
+        if(victim<0 || meshused[i]<meshused[victim])
+            victim=i;
+    };
+    if(victim<0) // Everything locked. Ah well.
+        victim=1+(int)(getRandom() % (MESHBUFSIZE-1));
+    return victim;
+}
+
+MPKT * meshGetMessage(uint8_t type){
+    int free=mesh_find(type);
+    if(free<0){
+        for(int i=0;i<MESHBUFSIZE;i++){
+            if ((meshbuffer[i].flags&MF_USED)==0){
+                free=i;
+                break;
+            };
         };
     };
-    if(free==-1){ // Buffer full. Ah well. Kill a random packet
-        free= (int)(getRandom() % MESHBUFSIZE);
+    if(free<0){
+        free=mesh_evict();
         meshbuffer[free].flags=MF_FREE;
     };
     if(meshbuffer[free].flags==MF_FREE){
@@ -101,7 +157,10 @@ MPKT * meshGetMessage(uint8_t type){
         MO_TYPE_set(meshbuffer[free].pkt,type);
         MO_GEN_set(meshbuffer[free].pkt,meshgen);
         meshbuffer[free].flags=MF_USED;
+        if(type<MESHTYPES)
+            mesh_index_set(type,free);
     };
+    meshused[free]=getTimer();
     return &meshbuffer[free];
 }
 
@@ -159,11 +218,108 @@ void mesh_cleanup(void){
     };
 }
 
+// Queue a packet for sending, pkt==NULL flushes the queue.
+static void mesh_txqueue(uint8_t buf[][MESHPKTSIZE], int *ctr, const uint8_t *pkt){
+    uint8_t *pkts[NRF_TXFIFO];
+    uint8_t status[NRF_TXFIFO];
+
+    if(pkt!=NULL)
+        memcpy(buf[(*ctr)++],pkt,MESHPKTSIZE);
+
+    if(*ctr==NRF_TXFIFO || (pkt==NULL && *ctr>0)){
+        for(int i=0;i<*ctr;i++)
+            pkts[i]=buf[i];
+        nrf_snd_pkt_crc_burst(*ctr,MESHPKTSIZE,pkts,status);
+        //Check status? But what would we do...
+        *ctr=0;
+    };
+}
+
+static int mesh_digest_send(uint8_t buf[][MESHPKTSIZE], int *ctr){
+    uint8_t slots[MESHBUFSIZE];
+    __attribute__ ((aligned (4))) uint8_t pkt[MESHPKTSIZE];
+    int n=0;
+    int parts=0;
+
+    // collect sendable slots sorted by type
+    for(int i=1;i<MESHBUFSIZE;i++){
+        if(!(meshbuffer[i].flags&MF_USED) || (meshbuffer[i].flags&MF_LOCK))
+            continue;
+        int j=n++;
+        for(;j>0 && MO_TYPE(meshbuffer[slots[j-1]].pkt) >
+                MO_TYPE(meshbuffer[i].pkt);j--)
+            slots[j]=slots[j-1];
+        slots[j]=i;
+    };
+
+    int idx=0;
+    uint8_t lo=0;
+    do {
+        memset(pkt,0,MESHPKTSIZE);
+        MO_TYPE_set(pkt,MESH_DIGEST);
+        MO_GEN_set(pkt,meshgen);
+        MO_TIME_set(pkt,getSeconds());
+
+        uint8_t *e=MO_BODY(pkt)+2;
+        for(int j=0;j<MD_ENTRIES && idx<n;j++,idx++){
+            uint8_t *mp=meshbuffer[slots[idx]].pkt;
+            uint32_t t=MO_TIME(mp);
+            e[0]=MO_TYPE(mp);
+            e[1]=t>>16;
+            e[2]=t>>8;
+            e[3]=t;
+            e+=MD_ENTRYSIZE;
+        };
+        MO_BODY(pkt)[0]=lo;
+        if(idx<n){
+            MO_BODY(pkt)[1]=MO_TYPE(meshbuffer[slots[idx-1]].pkt);
+            lo=MO_BODY(pkt)[1]+1;
+        }else{
+            MO_BODY(pkt)[1]=0xff;
+        };
+        mesh_txqueue(buf,ctr,pkt);
+        parts++;
+    } while (idx<n);
+
+    return parts;
+}
+
+// Mark everything the sender of a digest is missing or has older.
+static void mesh_digest_recv(uint8_t *pkt){
+    uint8_t lo=MO_BODY(pkt)[0];
+    uint8_t hi=MO_BODY(pkt)[1];
+
+    for(int i=1;i<MESHBUFSIZE;i++){
+        if(!(meshbuffer[i].flags&MF_USED) || (meshbuffer[i].flags&MF_LOCK))
+            continue;
+        uint8_t type=MO_TYPE(meshbuffer[i].pkt);
+        if(type<lo || type>hi)
+            continue;
+
+        int want=1; // not in the digest: missing
+        uint8_t *e=MO_BODY(pkt)+2;
+        for(int j=0;j<MD_ENTRIES;j++,e+=MD_ENTRYSIZE){
+            if(e[0]!=type)
+                continue;
+            uint32_t t=(e[1]<<16)|(e[2]<<8)|e[3];
+            // 24-bit serial number arithmetic
+            want=((int32_t)((MO_TIME(meshbuffer[i].pkt)-t)<<8))>0;
+            break;
+        };
+        if(want)
+            meshwant[i]=1;
+    };
+}
+
 void mesh_sendloop(void){
     int ctr=0;
-    __attribute__ ((aligned (4))) uint8_t buf[32];
-    int status;
+    __attribute__ ((aligned (4))) uint8_t buf[NRF_TXFIFO][MESHPKTSIZE];
     uint32_t rnd=0xffffffff;
+    static uint8_t rounds=0;
+    char digest=0;
+
+    if(GLOBAL(meshdigest))
+        digest=(++rounds % M_DIGESTFULL)!=0;
 
     if(meshnice)
         rnd=getRandom();
@@ -190,18 +346,22 @@ void mesh_sendloop(void){
             continue;
         if(meshbuffer[i].flags&MF_LOCK)
             continue;
+        if(digest && i>0 && !meshwant[i])
+            continue;
         if(meshnice&0xf){
             if((rnd++)%0xf < (meshnice&0x0f)){
                 meshincctr++;
                 continue;
             };
         };
-        ctr++;
-        memcpy(buf,meshbuffer[i].pkt,MESHPKTSIZE);
-        status=nrf_snd_pkt_crc_encr(MESHPKTSIZE,buf,NULL);
-        //Check status? But what would we do...
+        meshwant[i]=0;
+        mesh_txqueue(buf,&ctr,meshbuffer[i].pkt);
     };
 
+    if(GLOBAL(meshdigest))
+        mesh_digest_send(buf,&ctr);
+    mesh_txqueue(buf,&ctr,NULL);
+
     nrf_config_set(&oldconfig);
 }
 
@@ -214,7 +374,7 @@ void mesh_recvqloop_setup(void){
 
     mesh_cleanup();
 
-    nrf_rcv_pkt_start(R_CONFIG_EN_CRC);
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC);
 }
 
 static inline uint32_t popcount(uint32_t *buf, uint8_t n){
@@ -235,7 +395,7 @@ uint8_t mesh_recvqloop_work(void){
     __attribute__ ((aligned (4))) uint8_t buf[32];
     signed int len;
 
-        len=nrf_rcv_pkt_poll_dec(sizeof(buf),buf,NULL);
+        len=nrf_rcv_irq_get_dec(sizeof(buf),buf,NULL);
 
         // Receive
         if(len<=0){
@@ -266,6 +426,12 @@ uint8_t mesh_recvqloop_work(void){
             return 0;
         };
 
+        // Digest: note what the neighbour is missing, don't store it.
+        if(MO_TYPE(buf)==MESH_DIGEST){
+            mesh_digest_recv(buf);
+            return 1;
+        };
+
         // Set new time iff I don't have a valid one.
 		if((mesh_mode & MM_TIME)==0){
 			if(MO_TYPE(buf)=='T'){
@@ -325,8 +491,11 @@ uint8_t mesh_recvqloop_work(void){
 
         // only accept newer/better packets
         if(mpkt->flags==MF_USED)
-            if(MO_TIME(buf)<=MO_TIME(mpkt->pkt))
+            if(MO_TIME(buf)<=MO_TIME(mpkt->pkt)){
+                if(MO_TIME(buf)<MO_TIME(mpkt->pkt)) // sender is behind
+                    meshwant[mpkt-meshbuffer]=1;
                 return 2;
+            };
 
 #if 0
         if((MO_TYPE(buf)>='A' && MO_TYPE(buf)<='C') ||
@@ -341,7 +510,7 @@ uint8_t mesh_recvqloop_work(void){
 }
 
 void mesh_recvqloop_end(void){
-    nrf_rcv_pkt_end();
+    nrf_rcv_irq_end();
     nrf_config_set(&oldconfig);
 }
 
@@ -377,8 +546,10 @@ uint8_t mesh_recvloop_plus(uint8_t state){
             }else{
                 delayms_power(10);
             };
-            if(getTimer()>recvend || pktctr>MESHBUFSIZE)
+            if(getTimer()>recvend || pktctr>MESHBUFSIZE){
+                mesh_recvqloop_end();
                 state=QS_END;
+            };
     };
     return state;
 }
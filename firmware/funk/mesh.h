@@ -1,13 +1,26 @@
 #ifndef __MESH_H_
 #define __MESH_H_
 
+#ifndef MESHBUFSIZE
 #define MESHBUFSIZE 10
+#endif
 #define MESHPKTSIZE 32
 
 #define M_SENDINT 500
 #define M_RECVINT 1000
 #define M_RECVTIM 100
 
+/* Digest mode (GLOBAL(meshdigest)): instead of rebroadcasting everything,
+ * send digest packets and only the packets a neighbour's digest shows
+ * to be missing or older there.
+ * Body: [0] first type covered, [1] last type covered,
+ *       MD_ENTRIES x (type, 24 low bits of MO_TIME), sorted by type.
+ */
+#define MESH_DIGEST  '#'
+#define MD_ENTRIES   5
+#define MD_ENTRYSIZE 4
+#define M_DIGESTFULL 16 /* full rebroadcast every n-th round anyway */
+
 #define MESH_CHANNEL 83
 #define MESH_MAC     "ORBIT"
 
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <basic/basic.h>
 #include <nrf24l01p.h>
 #include "core/ssp/ssp.h"
@@ -7,6 +8,9 @@
 
 uint8_t _nrfresets=0;
 
+// set by nrf_rcv_irq_start(), see below
+static volatile uint8_t nrf_irqmode=0;
+
 /*-----------------------------------------------------------------------*/
 /* Transmit a byte via SPI                                               */
 /*-----------------------------------------------------------------------*/
@@ -18,8 +22,10 @@ inline void rcv_spi(uint8_t *dat) {
     sspReceive(0, dat, 1);
 }
 
-#define CS_LOW()    gpioSetValue(RB_SPI_NRF_CS, 0)
-#define CS_HIGH()   gpioSetValue(RB_SPI_NRF_CS, 1)
+#define CS_LOW()    do{ sspbusAcquire(SSPBUS_NRF); \
+                        gpioSetValue(RB_SPI_NRF_CS, 0); }while(0)
+#define CS_HIGH()   do{ gpioSetValue(RB_SPI_NRF_CS, 1); \
+                        sspbusRelease(SSPBUS_NRF); }while(0)
 #define CE_LOW()    gpioSetValue(RB_NRF_CE, 0)
 #define CE_HIGH()   gpioSetValue(RB_NRF_CE, 1)
 
@@ -95,6 +101,9 @@ void nrf_write_long(const uint8_t cmd, int len, const uint8_t* data){
 
 // High-Level:
 void nrf_rcv_pkt_start(char config){
+    // polling receivers must not have the IRQ handler drain the FIFO
+    gpioIntDisable(RB_NRF_IRQ);
+    nrf_irqmode=0;
 
     nrf_write_reg(R_CONFIG,
             R_CONFIG_PRIM_RX| // Receive mode
@@ -171,68 +180,181 @@ void nrf_rcv_pkt_end(void){
 
 // High-Level:
 int nrf_rcv_pkt_time_encr(int maxtime, int maxsize, uint8_t * pkt, uint32_t const key[4]){
-    uint8_t len;
-    uint8_t status=0;
-    uint16_t cmpcrc;
+    int len;
+    uint32_t end=getTimer()+maxtime/SYSTICKSPEED;
 
-    nrf_write_reg(R_CONFIG,
-            R_CONFIG_PRIM_RX| // Receive mode
-            R_CONFIG_PWR_UP|  // Power on
-            R_CONFIG_EN_CRC   // CRC on, single byte
-            );
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC); // CRC on, single byte
 
-    nrf_cmd(C_FLUSH_RX);
-    nrf_write_reg(R_STATUS,0);
+    for(int i=0;i<maxsize;i++) pkt[i] = 0x00; // Sanity: clear packet buffer
 
-    CE_HIGH();
+    do {
+        len=nrf_rcv_irq_get_dec(maxsize,pkt,key);
+        if(len>0)
+            break;
+        WFI;
+    } while (getTimer()<end);
 
-    for(int i=0;i<maxsize;i++) pkt[i] = 0x00; // Sanity: clear packet buffer
+    nrf_rcv_irq_end();
 
-#define LOOPY 10
-    for (;maxtime >= LOOPY;maxtime-=LOOPY){
-        delayms(LOOPY);
-        status =nrf_cmd_status(C_NOP);
-        if( (status & R_STATUS_RX_DR) == R_STATUS_RX_DR){
-            if( (status & R_STATUS_RX_P_NO) == R_STATUS_RX_FIFO_EMPTY){
-                nrf_cmd(C_FLUSH_RX);
-                delayms(1);
-                nrf_write_reg(R_STATUS,0);
-                continue;
-            }else{ // Get/Check packet...
-                nrf_read_long(C_R_RX_PL_WID,1,&len);
-                if(len>32 || len==0){
-                    continue;
-                    return -2; // no packet error
-                };
+    if(len<=0)
+        return 0; // timeout
 
-                if(len>maxsize){
-                    continue;
-                    return -1; // packet too large
-                };
+    return len;
+}
 
-                nrf_read_pkt(len,pkt);
-                if(key != NULL)
-                    xxtea_decode_words((uint32_t*)pkt,len/4,key);
+/*-----------------------------------------------------------------------*/
+/* Interrupt driven receive                                              */
+/*-----------------------------------------------------------------------*/
 
-                cmpcrc=crc16(pkt,len-2);
-                if(cmpcrc != (pkt[len-2] <<8 | pkt[len-1])) {
-                    continue;
-                    return -3; // CRC failed
-                };
-                break;
-            };
+static NRF_RXPKT nrf_rxring[NRF_RXRING];
+static volatile uint8_t nrf_rxhead=0;
+static volatile uint8_t nrf_rxtail=0;
+volatile uint8_t _nrfdrops=0;
+
+#define RXRING_NEXT(x) (((x)+1)&(NRF_RXRING-1))
+
+// SSP0 is shared with the LCD and the dataflash. Those go through
+// the arbiter, but l0dables may still drive their own CS lines.
+static int nrf_bus_idle(void){
+#ifdef __arm__
+    if(!gpioGetValue(RB_SPI_NRF_CS) || !gpioGetValue(RB_LCD_CS) ||
+            !gpioGetValue(RB_SPI_CS_DF))
+        return 0;
+#endif
+    return 1;
+}
+
+static int nrf_irq_asserted(void){
+#ifdef __arm__
+    return gpioGetValue(RB_NRF_IRQ)==0; // IRQ is active low
+#else
+    return 1;
+#endif
+}
+
+// Move everything in the RX FIFO into the ring.
+static void nrf_rxring_fill(void){
+    uint8_t status;
+    uint8_t len;
+    NRF_RXPKT * p;
+
+    nrf_write_reg(R_STATUS,R_STATUS_RX_DR);
+    while(1){
+        status=nrf_cmd_status(C_NOP);
+        if((status & R_STATUS_RX_P_NO) == R_STATUS_RX_FIFO_EMPTY)
+            break;
+
+        nrf_read_long(C_R_RX_PL_WID,1,&len);
+        if(len>MAX_PKT || len==0){ // corrupt width: datasheet says flush
+            nrf_cmd(C_FLUSH_RX);
+            nrf_write_reg(R_STATUS,R_STATUS_RX_DR);
+            break;
         };
+
+        // If the ring is full, the packet is read into the free
+        // head slot and dropped.
+        p=&nrf_rxring[nrf_rxhead];
+        nrf_read_pkt(len,p->pkt);
+        p->len=len;
+        p->time=getTimer();
+        if(RXRING_NEXT(nrf_rxhead) == nrf_rxtail)
+            _nrfdrops++;
+        else
+            nrf_rxhead=RXRING_NEXT(nrf_rxhead);
+
+        nrf_write_reg(R_STATUS,R_STATUS_RX_DR);
     };
+}
 
-    CE_LOW();
-    CS_HIGH();
+static void nrf_rxring_deferred(void){
+    if(nrf_irqmode)
+        nrf_rxring_fill();
+}
 
-    if(maxtime<LOOPY)
-        return 0; // timeout
+void PIOINT0_IRQHandler(void){
+    if(gpioIntStatus(RB_NRF_IRQ)){
+        gpioIntClear(RB_NRF_IRQ);
+        if(!nrf_irqmode)
+            return;
+        // If the bus is busy, the owner runs the fill once it is done
+        // (or between LCD pages). Users that bypass the arbiter leave
+        // the IRQ line low and nrf_rcv_irq_get() picks up the packets.
+        if(sspbusTryAcquire(SSPBUS_NRF)){
+            if(nrf_bus_idle())
+                nrf_rxring_fill();
+            sspbusRelease(SSPBUS_NRF);
+        }else{
+            sspbusDefer(SSPBUS_NRF, nrf_rxring_deferred);
+        };
+    };
+}
+
+void nrf_rcv_irq_start(char config){
+    gpioIntDisable(RB_NRF_IRQ);
+    nrf_rxhead=0;
+    nrf_rxtail=0;
+
+    // Only RX_DR should pull the IRQ line
+    nrf_rcv_pkt_start(config|R_CONFIG_MASK_TX_DS|R_CONFIG_MASK_MAX_RT);
+
+    nrf_irqmode=1;
+    gpioIntClear(RB_NRF_IRQ);
+    gpioIntEnable(RB_NRF_IRQ);
+}
+
+int nrf_rcv_irq_get(int maxsize, uint8_t * pkt, uint32_t * time){
+    NRF_RXPKT * p;
+    int len;
+
+    if(nrf_rxhead==nrf_rxtail){
+        if(!nrf_irq_asserted())
+            return 0;
+        // IRQ was deferred (or missed), drain the FIFO ourselves
+        gpioIntDisable(RB_NRF_IRQ);
+        nrf_rxring_fill();
+        gpioIntEnable(RB_NRF_IRQ);
+        if(nrf_rxhead==nrf_rxtail)
+            return 0;
+    };
+
+    p=&nrf_rxring[nrf_rxtail];
+    len=p->len;
+    if(len>maxsize){
+        len=-1; // packet too large
+    }else{
+        memcpy(pkt,p->pkt,len);
+        if(time!=NULL)
+            *time=p->time;
+    };
+    nrf_rxtail=RXRING_NEXT(nrf_rxtail);
 
     return len;
 }
 
+int nrf_rcv_irq_get_dec(int maxsize, uint8_t * pkt, uint32_t const key[4]){
+    int len;
+    uint16_t cmpcrc;
+
+    len=nrf_rcv_irq_get(maxsize,pkt,NULL);
+
+    if(len <=0)
+        return len;
+
+    if(key!=NULL)
+        xxtea_decode_words((uint32_t*)pkt,len/4,key);
+
+    cmpcrc=crc16(pkt,len-2);
+    if(cmpcrc != (pkt[len-2] <<8 | pkt[len-1])) {
+        return -3; // CRC failed
+    };
+    return len;
+}
+
+void nrf_rcv_irq_end(void){
+    gpioIntDisable(RB_NRF_IRQ);
+    nrf_irqmode=0;
+    nrf_rcv_pkt_end();
+}
 
 /* assumes all nrf setup already done */
 char nrf_snd_pkt(int size, uint8_t * pkt){
@@ -271,6 +393,91 @@ char nrf_snd_pkt_crc_encr(int size, uint8_t * pkt, uint32_t const key[4]){
     return nrf_snd_pkt(size,pkt);
 }
 
+// Time to wait for a FIFO of packets to go out (in systicks)
+#define BURST_TIMEOUT (10/SYSTICKSPEED+1)
+
+/* assumes all nrf setup already done */
+int nrf_snd_pkt_burst(int n, int size, uint8_t * pkt[], uint8_t * status){
+    int sent=0;
+    uint8_t st;
+    uint32_t end;
+
+    if(size > MAX_PKT)
+        size=MAX_PKT;
+
+    for(int i=0;i<n;i++)
+        status[i]=0;
+
+    nrf_cmd(C_FLUSH_TX);
+    nrf_write_reg(R_STATUS,R_STATUS_TX_DS|R_STATUS_MAX_RT);
+
+    for(int i=0;i<n;){
+        int first=i;
+
+        // Fill the FIFO
+        for(;i<n && i-first<NRF_TXFIFO;i++)
+            nrf_write_long(C_W_TX_PAYLOAD,size,pkt[i]);
+
+        CE_HIGH();
+        end=getTimer()+BURST_TIMEOUT;
+        while(first<i){
+            st=nrf_cmd_status(C_NOP);
+            if(st & R_STATUS_MAX_RT){ // no ack: give up on this one
+                status[first++]=st;
+                nrf_cmd(C_FLUSH_TX);
+                nrf_write_reg(R_STATUS,R_STATUS_MAX_RT|R_STATUS_TX_DS);
+                break;
+            };
+            if(st & R_STATUS_TX_DS){
+                nrf_write_reg(R_STATUS,R_STATUS_TX_DS);
+                status[first++]=st;
+                sent++;
+            };
+            // TX_DS of back-to-back packets can coalesce,
+            // an empty FIFO means everything went out.
+            if(nrf_read_reg(R_FIFO_STATUS) & R_FIFO_STATUS_TX_EMPTY){
+                while(first<i){
+                    status[first++]=st|R_STATUS_TX_DS;
+                    sent++;
+                };
+                nrf_write_reg(R_STATUS,R_STATUS_TX_DS);
+                break;
+            };
+            if(getTimer()>end){
+                nrf_cmd(C_FLUSH_TX);
+                break;
+            };
+        };
+        CE_LOW();
+        if(first<i) // failure, don't bother with the rest
+            break;
+    };
+
+    return sent;
+}
+
+int nrf_snd_pkt_crc_encr_burst(int n, int size, uint8_t * pkt[],
+        uint32_t const key[4], uint8_t * status){
+
+    if(size > MAX_PKT)
+        size=MAX_PKT;
+
+    nrf_write_reg(R_CONFIG,
+            R_CONFIG_PWR_UP|  // Power on
+            R_CONFIG_EN_CRC   // CRC on, single byte
+            );
+
+    for(int i=0;i<n;i++){
+        uint16_t crc=crc16(pkt[i],size-2);
+        pkt[i][size-2]=(crc >>8) & 0xff;
+        pkt[i][size-1]=crc & 0xff;
+        if(key !=NULL)
+            xxtea_encode_words((uint32_t*)pkt[i],size/4,key);
+    };
+
+    return nrf_snd_pkt_burst(n,size,pkt,status);
+}
+
 void nrf_set_rx_mac(int pipe, int rxlen, int maclen, const uint8_t * mac){
 #ifdef SAFE
     assert(maclen>=1 || maclen<=5);
@@ -386,9 +593,16 @@ void nrf_init() {
     gpioSetPullup(&RB_NRF_CE_IO, gpioPullupMode_PullUp);
     CE_LOW();
 
+    // IRQ pin, only enabled by nrf_rcv_irq_start()
+    gpioSetDir(RB_NRF_IRQ, gpioDirection_Input);
+    gpioSetPullup(&RB_NRF_IRQ_IO, gpioPullupMode_PullUp);
+    gpioSetInterrupt(RB_NRF_IRQ, gpioInterruptSense_Edge,
+            gpioInterruptEdge_Single, gpioInterruptEvent_ActiveLow);
+    gpioIntDisable(RB_NRF_IRQ);
+    nrf_irqmode=0;
+
     // Setup for nrf24l01+
     // power up takes 1.5ms - 3.5ms (depending on crystal)
-    CS_LOW();
     nrf_write_reg(R_CONFIG,
             R_CONFIG_PRIM_RX| // Receive mode
             R_CONFIG_PWR_UP|  // Power on
@@ -425,8 +639,6 @@ void nrf_startCW() {
 
     // Setup for nrf24l01+
     // power up takes 1.5ms - 3.5ms (depending on crystal)
-    CS_LOW();
-
     nrf_write_reg(R_CONFIG, R_CONFIG_PWR_UP);
     delayms(2);
     nrf_write_reg(R_RF_SETUP, R_RF_SETUP_CONT_WAVE |
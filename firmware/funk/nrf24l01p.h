@@ -117,6 +117,13 @@
 #define R_STATUS_RX_FIFO_EMPTY   0x0E
 #define R_STATUS_TX_FULL         0x01
 
+//FIFO_STATUS register definitions
+#define R_FIFO_STATUS_TX_REUSE   0x40
+#define R_FIFO_STATUS_TX_FULL    0x20
+#define R_FIFO_STATUS_TX_EMPTY   0x10
+#define R_FIFO_STATUS_RX_FULL    0x02
+#define R_FIFO_STATUS_RX_EMPTY   0x01
+
 //DYNPD register definitions
 #define R_DYNPD_DPL_P5           0x20
 #define R_DYNPD_DPL_P4           0x10
@@ -156,6 +163,15 @@ char nrf_snd_pkt(int size, uint8_t * pkt);
     nrf_snd_pkt_crc_encr(size, pkt, NULL)
 char nrf_snd_pkt_crc_encr(int size, uint8_t * pkt, uint32_t const k[4]);
 
+// burst send: fill the TX FIFO and wait for TX_DS/MAX_RT.
+// status[i] gets the STATUS register for packet i
+// (R_STATUS_TX_DS on success), return value is the number sent.
+#define NRF_TXFIFO 3 // depth of the hardware TX FIFO
+int nrf_snd_pkt_burst(int n, int size, uint8_t * pkt[], uint8_t * status);
+#define nrf_snd_pkt_crc_burst(n, size, pkt, status) \
+    nrf_snd_pkt_crc_encr_burst(n, size, pkt, NULL, status)
+int nrf_snd_pkt_crc_encr_burst(int n, int size, uint8_t * pkt[], uint32_t const k[4], uint8_t * status);
+
 void nrf_init() ;
 void nrf_off() ;
 void nrf_startCW();
@@ -183,6 +199,24 @@ void nrf_rcv_pkt_start(char config);
 int nrf_rcv_pkt_poll(int maxsize, uint8_t * pkt);
 int nrf_rcv_pkt_poll_dec(int maxsize, uint8_t * pkt, uint32_t const key[4]);
 
+// interrupt driven receive IF: the IRQ handler drains the
+// RX FIFO into a ring of timestamped packets.
+#ifndef NRF_RXRING
+#define NRF_RXRING 4 // must be a power of two
+#endif
+
+typedef struct {
+    uint32_t time;   // getTimer() at reception
+    uint8_t len;
+    uint8_t pkt[MAX_PKT];
+} NRF_RXPKT;
+
+void nrf_rcv_irq_start(char config);
+int nrf_rcv_irq_get(int maxsize, uint8_t * pkt, uint32_t * time);
+int nrf_rcv_irq_get_dec(int maxsize, uint8_t * pkt, uint32_t const key[4]);
+void nrf_rcv_irq_end(void);
+extern volatile uint8_t _nrfdrops;
+
 // more utility.
 void nrf_rcv_pkt_end(void);
 void nrf_check_reset(void);
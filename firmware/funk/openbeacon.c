@@ -113,24 +113,27 @@ static void openbeaconSendPacket(uint32_t id, uint32_t seq,
         nrf_snd_pkt_crc_encr(16,buf,NULL);
 #endif
     }else{
+        uint8_t buf2[16];
+        uint8_t *pkts[2] = {buf, buf2};
+        uint8_t status[2];
+        int n = 1;
+
         if( strlen(GLOBAL(nickname)) > 8 )
             buf[1] = 0x24;
         nrf_set_strength(3);
         uint32touint8p(id, buf+2);
         memcpy(buf+6, GLOBAL(nickname), 8);
+        if( strlen(GLOBAL(nickname)) >= 9 ){
+            memcpy(buf2, buf, 6);
+            buf2[1]=0x25;
+            memcpy(buf2+6, GLOBAL(nickname)+8, 8);
+            n = 2;
+        }
+        // both halves of the nick go out in one burst
 #if ENCRYPT_OPENBEACON
-        nrf_snd_pkt_crc_encr(16,buf,openbeaconkey);
-#else
-        nrf_snd_pkt_crc_encr(16,buf,NULL);
-#endif
-        if( strlen(GLOBAL(nickname)) < 9 )
-            return;
-        buf[1]=0x25;
-        memcpy(buf+6, GLOBAL(nickname)+8, 8);
-#if ENCRYPT_OPENBEACON
-        nrf_snd_pkt_crc_encr(16,buf,openbeaconkey);
+        nrf_snd_pkt_crc_encr_burst(n,16,pkts,openbeaconkey,status);
 #else
-        nrf_snd_pkt_crc_encr(16,buf,NULL);
+        nrf_snd_pkt_crc_encr_burst(n,16,pkts,NULL,status);
 #endif
     }   
 }
@@ -1,109 +1,255 @@
+#include <string.h>
 #include "rftransfer.h"
 #include "nrf24l01p.h"
 #include <basic/basic.h>
+#include <basic/byteorder.h>
 #include <basic/random.h>
 #include <core/systick/systick.h>
 #include <lcd/print.h>
 
+/* Packets (32 bytes, last two are the CRC):
+ * 'L' size[2] rand[2] 'W' window  - setup, 'W' announces windowed mode
+ * 'D' seq[2]  rand[2] data[25]    - data
+ * 'P' seq[2]  rand[2]             - poll: please send an 'A'
+ * 'A' base[2] rand[2] map[4]      - ack: all below base received,
+ *                                   bit n of map: base+n received
+ * 'C' crc[2]  rand[2]             - done, answered by 'A' with base=#pkts
+ *
+ * A receiver that never answers gets the old sequential protocol.
+ */
+
 #define MAXPACKET   32
-void rftransfer_send(uint16_t size, uint8_t *data)
-{
-    uint8_t buf[MAXPACKET];
-    buf[0] = 'L';
-    buf[1] = size >> 8;
-    buf[2] = size & 0xFF;
+#define RF_DATA     5
+#define RF_DATALEN  (MAXPACKET-2-RF_DATA)
+#define RF_WINDOW   32      // packets, must fit into the ack map
+#define RF_POLLS    3       // polls before giving up
+#define RF_ACKWAIT  30      // ms to wait for an ack
+#define RF_GAPMAX   20      // ms, also the gap of the old protocol
 
-    uint16_t rand = getRandom() & 0xFFFF;
+static void rf_header(uint8_t *buf, uint8_t type, uint16_t val, uint16_t rand)
+{
+    memset(buf, 0, MAXPACKET);
+    buf[0] = type;
+    buf[1] = val >> 8;
+    buf[2] = val & 0xFF;
     buf[3] = rand >> 8;
     buf[4] = rand & 0xFF;
+}
 
+static void rf_data(uint8_t *buf, uint16_t seq, uint16_t rand,
+        uint8_t *data, uint16_t size)
+{
+    uint16_t pos = seq*RF_DATALEN;
+    uint16_t len = size-pos;
+
+    if( len > RF_DATALEN )
+        len = RF_DATALEN;
+    rf_header(buf, 'D', seq, rand);
+    memcpy(buf+RF_DATA, data+pos, len);
+}
+
+/* buf is scratch space for the received packets, the sender passes
+ * one of its own so the ack wait does not add to its stack. */
+static int rf_wait_ack(uint8_t *buf, uint16_t rand, uint16_t *base,
+        uint32_t *map)
+{
+    uint32_t end = getTimer()+RF_ACKWAIT/SYSTICKSPEED+1;
+    int n, ret = 0;
+
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC);
+    do {
+        n = nrf_rcv_irq_get_dec(MAXPACKET, buf, NULL);
+        if( n == 32 && buf[0] == 'A' && ((buf[3]<<8)|buf[4])==rand ){
+            *base = (buf[1]<<8) | buf[2];
+            *map = uint8ptouint32(buf+RF_DATA);
+            ret = 1;
+            break;
+        }
+        if( n <= 0 )
+            WFI;
+    } while( getTimer() < end );
+    nrf_rcv_irq_end();
+
+    return ret;
+}
+
+static void rf_send_ack(uint16_t base, uint32_t map, uint16_t rand)
+{
+    uint8_t buf[MAXPACKET];
+
+    rf_header(buf, 'A', base, rand);
+    uint32touint8p(map, buf+RF_DATA);
+    nrf_rcv_irq_end();
+    nrf_snd_pkt_crc(32,buf);
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC);
+}
+
+static void rf_send_legacy(uint16_t size, uint8_t *data, uint16_t rand,
+        uint16_t crc)
+{
+    uint8_t buf[MAXPACKET];
+    uint16_t npkts = (size+RF_DATALEN-1)/RF_DATALEN;
+
+    // in case the first one got lost
+    rf_header(buf, 'L', size, rand);
     nrf_snd_pkt_crc(32,buf);     //setup packet
-    delayms(20);
-    uint16_t index = 0;
-    uint8_t i;
+    delayms(RF_GAPMAX);
+
+    for(uint16_t seq=0; seq<npkts; seq++){
+        rf_data(buf, seq, rand, data, size);
+        nrf_snd_pkt_crc(32,buf);     //data packet
+        delayms(RF_GAPMAX);
+    }
+
+    rf_header(buf, 'C', crc, rand);
+    nrf_snd_pkt_crc(32,buf);
+    delayms(RF_GAPMAX);
+}
+
+void rftransfer_send(uint16_t size, uint8_t *data)
+{
+    uint8_t buf[NRF_TXFIFO][MAXPACKET];
+    uint8_t *pkts[NRF_TXFIFO];
+    uint8_t status[NRF_TXFIFO];
+    uint16_t npkts = (size+RF_DATALEN-1)/RF_DATALEN;
+    uint16_t rand = getRandom() & 0xFFFF;
     uint16_t crc = crc16(data,size);
+    uint16_t base = 0, ackbase = 0;
+    uint32_t map = 0, ackmap = 0;
+    uint8_t gap = RF_GAPMAX/4;
+    uint8_t acked = 0;
+    int t;
+
+    for(int i=0; i<NRF_TXFIFO; i++)
+        pkts[i] = buf[i];
+
+    rf_header(buf[0], 'L', size, rand);
+    buf[0][RF_DATA] = 'W';
+    buf[0][RF_DATA+1] = RF_WINDOW;
+    nrf_snd_pkt_crc(32,buf[0]);     //setup packet
+    delayms(RF_GAPMAX);
 
-    while(size){
-        buf[0] = 'D';
-        buf[1] = index >> 8;
-        buf[2] = index & 0xFF;
-        buf[3] = rand >> 8;
-        buf[4] = rand & 0xFF;
-        for(i=5; i<MAXPACKET-2 && size>0; i++,size--){
-            buf[i] = *data++;
+    while( base < npkts ){
+        uint16_t end = base+RF_WINDOW;
+        int n = 0;
+
+        if( end > npkts )
+            end = npkts;
+
+        // (re)send everything in the window that is not acked yet
+        for(uint16_t seq=base; seq<end; seq++){
+            if( map & (1UL<<(seq-base)) )
+                continue;
+            rf_data(buf[n++], seq, rand, data, size);
+            if( n == NRF_TXFIFO ){
+                nrf_snd_pkt_crc_burst(n, MAXPACKET, pkts, status);
+                n = 0;
+                if( gap )
+                    delayms(gap);
+            }
         }
-        index++;
-        nrf_snd_pkt_crc(32,buf);     //data packet
-        delayms(20);
+        if( n )
+            nrf_snd_pkt_crc_burst(n, MAXPACKET, pkts, status);
+
+        for(t=0; t<RF_POLLS; t++){
+            rf_header(buf[0], 'P', end, rand);
+            nrf_snd_pkt_crc(32,buf[0]);
+            if( rf_wait_ack(buf[1], rand, &ackbase, &ackmap) )
+                break;
+        }
+        if( t == RF_POLLS ){
+            if( !acked )    // nobody answers: old receiver
+                rf_send_legacy(size, data, rand, crc);
+            return;
+        }
+        acked = 1;
+
+        // adapt pacing to the loss in this round
+        uint8_t lost = 0;
+        for(uint16_t seq=ackbase; seq<end; seq++)
+            if( !(ackmap & (1UL<<(seq-ackbase))) )
+                lost++;
+        if( lost == 0 )
+            gap /= 2;
+        else if( gap < RF_GAPMAX )
+            gap = gap*2+1;
+
+        base = ackbase;
+        map = ackmap;
     }
 
-    buf[0] = 'C';
-    buf[1] = crc >> 8;
-    buf[2] = crc & 0xFF;
-    buf[3] = rand >> 8;
-    buf[4] = rand & 0xFF;
-    nrf_snd_pkt_crc(32,buf);     //setup packet
-    delayms(20);
+    for(t=0; t<RF_POLLS; t++){
+        rf_header(buf[0], 'C', crc, rand);
+        nrf_snd_pkt_crc(32,buf[0]);
+        if( rf_wait_ack(buf[1], rand, &ackbase, &ackmap) &&
+                ackbase == npkts )
+            break;
+    }
 }
 
 int16_t rftransfer_receive(uint8_t *buffer, uint16_t maxlen, uint16_t timeout)
 {
     uint8_t buf[MAXPACKET];
     uint8_t state = 0;
-    uint16_t pos = 0, seq = 0, size = 0, rand = 0, crc = 0;
+    uint16_t base = 0, npkts = 0, size = 0, rand = 0, crc = 0, seq;
+    uint32_t map = 0;
     int n,i;
+    int16_t ret = -2;
     unsigned int currentTick = systickGetTicks();
     unsigned int startTick = currentTick;
-    
-    while(systickGetTicks() < (startTick+timeout) ){//this fails if either overflows
-        n = nrf_rcv_pkt_time(1000, MAXPACKET, buf);
+
+    nrf_rcv_irq_start(R_CONFIG_EN_CRC);
+    while(state != 2 && systickGetTicks() < (startTick+timeout) ){//this fails if either overflows
+        n = nrf_rcv_irq_get_dec(MAXPACKET, buf, NULL);
+        if( n <= 0 ){
+            WFI;
+            continue;
+        }
         switch(state){
             case 0:
                 if( n == 32 && buf[0] == 'L' ){
                     size = (buf[1] << 8) | buf[2];
                     rand =  (buf[3] << 8) | buf[4];
-                    seq = 0;
-                    pos = 0;
+                    npkts = (size+RF_DATALEN-1)/RF_DATALEN;
+                    base = 0;
+                    map = 0;
                     if( size <= maxlen ){
-                        //lcdClear();
-                        //lcdPrint("got l="); lcdPrintInt(size);
-                        //lcdPrintln(""); lcdRefresh();
                         state = 1;
                     }
                 }
             break;
             case 1:
-                if( n == 32 && buf[0] == 'D' && ((buf[3]<<8)|buf[4])==rand ){
-                    //lcdPrint("got d"); lcdRefresh();
-                    if( seq == ((buf[1]<<8)|buf[2]) ){
-                        //lcdPrintln(" in seq"); lcdRefresh();
-                            for(i=5; i<n-2 && pos<size; i++,pos++){
-                                buffer[pos] = buf[i];
-                            }
-                            seq++;
+                if( n != 32 || ((buf[3]<<8)|buf[4]) != rand )
+                    break;
+                seq = (buf[1]<<8) | buf[2];
+                if( buf[0] == 'D' ){
+                    // accept anything inside the window, in any order
+                    if( seq >= base && seq < base+RF_WINDOW && seq < npkts ){
+                        uint16_t pos = seq*RF_DATALEN;
+                        for(i=RF_DATA; i<n-2 && pos<size; i++,pos++){
+                            buffer[pos] = buf[i];
+                        }
+                        map |= 1UL<<(seq-base);
+                        while( map & 1 ){
+                            map >>= 1;
+                            base++;
+                        }
                     }
-                }
-                if( pos == size ){
-                    //lcdPrintln("got all"); lcdRefresh();
+                }else if( buf[0] == 'P' ){
+                    rf_send_ack(base, map, rand);
+                }else if( buf[0] == 'C' && base == npkts ){
                     crc = crc16(buffer, size);
-                    state = 2;
-                }
-            break;
-            case 2:
-                if( n == 32 && buf[0] == 'C' && ((buf[3]<<8)|buf[4])==rand){
-                    //lcdPrint("got crc"); lcdRefresh();
-                    if( crc == ((buf[1]<<8)|buf[2]) ){
-                        //lcdPrintln(" ok"); lcdRefresh();
-                        return size;
+                    if( crc == seq ){
+                        rf_send_ack(base, 0, rand);
+                        ret = size;
                     }else{
-                        //lcdPrintln(" nok"); lcdRefresh();
-                        return -1;
+                        ret = -1;
                     }
+                    state = 2;
                 }
             break;
         };
     }
-    //lcdPrintln("Timeout"); lcdRefresh();
-    return -2;
+    nrf_rcv_irq_end();
+    return ret;
 }
-
@@ -1,6 +1,7 @@
 /* bricks.c - provided by briks <briks@riseup.net> */
 
 #include "basic/basic.h"
+#include "lcd/blit.h"
 #include "usetable.h"
 
 #define SCREEN_WIDTH  96
@@ -211,9 +212,9 @@ int playLevel(int levelNo, int pause) {
 void drawBricks(int bricks[FIELD_HEIGHT][FIELD_WIDTH]) {
 	for (int x = 0; x < FIELD_WIDTH; x++)
 		for (int y = 0; y < FIELD_HEIGHT; y++)
-			for (int i = 0; i < BRICK_WIDTH; i++)
-				for (int j = 0; j < BRICK_HEIGHT; j++)
-					lcdSetPixel(x * (BRICK_WIDTH + BRICK_SPACING) + i, y * (BRICK_HEIGHT + BRICK_SPACING) + j, bricks[y][x]);
+			lcdFillRect(x * (BRICK_WIDTH + BRICK_SPACING), y * (BRICK_HEIGHT + BRICK_SPACING),
+					x * (BRICK_WIDTH + BRICK_SPACING) + BRICK_WIDTH - 1, y * (BRICK_HEIGHT + BRICK_SPACING) + BRICK_HEIGHT - 1,
+					bricks[y][x] ? BLIT_OR : BLIT_ANDNOT);
 }
 
 void drawPxChk(int x, int y, int color) {
@@ -235,10 +236,8 @@ void drawBall(int ball[2], int color) {
 }
 
 void drawPaddle(int paddleX, int color) {
-	for (int x = 0; x < PADDLE_WIDTH; x++) {
-		lcdSetPixel(paddleX + x, PADDLE_Y, color);
-		lcdSetPixel(paddleX + x, PADDLE_Y + 1, color);
-	}
+	lcdFillRect(paddleX, PADDLE_Y, paddleX + PADDLE_WIDTH - 1, PADDLE_Y + 1,
+			color ? BLIT_OR : BLIT_ANDNOT);
 }
 
 int fieldIsCleared(int bricks[FIELD_HEIGHT][FIELD_WIDTH]) {
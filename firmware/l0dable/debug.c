@@ -18,6 +18,7 @@
 
 /**************************************************************************/
 void ChkFunk(void);
+void ChkBus(void);
 void ChkLight(void);
 void ChkBattery(void);
 void m_time(void);
@@ -33,6 +34,7 @@ static const struct MENU submenu_debug={ "debug", {
 	{ "ChkLight", &ChkLight},
 	{ "MeshInfo", &m_time},
 	{ "ChkFunk", &ChkFunk},
+	{ "ChkBus", &ChkBus},
 //	{ "Qstatus", &Qstatus},
 //	{ "ShowSP", &getsp},
 	{ "LcdRead", &lcdrtest},
@@ -318,6 +320,28 @@ void ChkFunk(){
     while(!getInputRaw())work_queue();
 }
 
+// frames, transactions and deferred/preempted per device
+void ChkBus(){
+    static const char * const name[SSPBUS_DEVICES]={"nrf","df ","lcd"};
+    while(!getInputRaw()){
+        lcdClear();
+        lcdPrintln("SSP0 bus:");
+        for(int i=0;i<SSPBUS_DEVICES;i++){
+            lcdPrint(name[i]);
+            lcdPrint(" ");
+            lcdPrintln(IntToStr(sspbusStats[i].frames,9,0));
+            lcdPrint(" ");
+            lcdPrint(IntToStr(sspbusStats[i].transactions,6,0));
+            lcdPrint(" ");
+            lcdPrint(IntToStr(sspbusStats[i].deferred,3,0));
+            lcdPrint("/");
+            lcdPrintln(IntToStr(sspbusStats[i].preempts,3,0));
+        };
+        lcdRefresh();
+        delayms_queue(200);
+    };
+}
+
 // //# MENU lcdread
 void lcdrtest(void){
     lcdClear();
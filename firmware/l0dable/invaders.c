@@ -7,6 +7,7 @@
 
 #include "lcd/render.h"
 #include "lcd/display.h"
+#include "lcd/blit.h"
 
 #include "lcd/fonts.h"
 #include "lcd/fonts/invaders.h"
@@ -425,21 +426,20 @@ static void draw_enemy() {
 static void draw_bunker() {
 	for (int b=0; b<BUNKERS; b++) {
 		memcpy(lcdBuffer+(RESX*1+BUNKER_X[b]),game.bunker+b,BUNKER_WIDTH);
+		/* buffer page 1 is screen rows RESY-16..RESY-9 */
+		lcdMarkDirty(RESX-BUNKER_X[b]-BUNKER_WIDTH, RESY-16,
+				RESX-1-BUNKER_X[b], RESY-9);
 	}
 }
 
 static void draw_shots() {
     if (game.shot_x != 255) {
-        for (int length=0; length<=5; length++) {
-            lcdSetPixel(game.shot_x, game.shot_y+length, true);
-        }
+        lcdVLine(game.shot_x, game.shot_y, game.shot_y+5, BLIT_OR);
     }
 
 	for (int col = 0; col < ENEMY_COLUMNS; col++) {
 		if (game.shots_x[col] != DISABLED) {
-			for (int length=0; length<=5; length++) {
-				lcdSetPixel(game.shots_x[col], game.shots_y[col]+length,true);
-			}
+			lcdVLine(game.shots_x[col], game.shots_y[col], game.shots_y[col]+5, BLIT_OR);
 		}
 	}
 
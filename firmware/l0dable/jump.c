@@ -10,6 +10,7 @@
 #include "basic/config.h"
 #include "basic/random.h"
 #include "lcd/render.h"
+#include "lcd/blit.h"
 #include "lcd/display.h"
 #include "funk/mesh.h"
 #include "usetable.h"
@@ -209,13 +210,8 @@ static void update_platforms(long frame_count) {
 static void draw_platforms() {
 	for(int i = 0; i < NUM_PLATFORMS; i++) {
 		if(game.platforms_y[i] <= RESY) {
-			for(int x = game.platforms_x1[i]; x <= game.platforms_x2[i]; x++) {
-				for(int y = game.platforms_y[i]; y < game.platforms_y[i]+PLATFORM_HEIGHT; y++) {
-					if(y >= 0 && y <= RESY) {
-						lcdSetPixel(x, y, 1);
-					}
-				}
-			}
+			lcdFillRect(game.platforms_x1[i], game.platforms_y[i],
+					game.platforms_x2[i], game.platforms_y[i]+PLATFORM_HEIGHT-1, BLIT_OR);
 		}
 	}
 }
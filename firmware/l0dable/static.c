@@ -26,6 +26,7 @@ void ram(void)
                lcdBuffer[y*RESX+x]=getRandom()&0xff;
          }
       }
+      lcdMarkDirtyAll();
       lcdDisplay();
    }
    return;
@@ -0,0 +1,115 @@
+#include <sysdefs.h>
+#include "lcd/display.h"
+#include "lcd/blit.h"
+
+/* lcdBuffer is upside down: screen (x,y) is buffer column RESX-1-x,
+ * row RESY-1-y (page row/8, bit row%8). Sprites use the same layout,
+ * so a blit is a plain shift of every sprite byte into two buffer
+ * pages. */
+
+/* bits of a buffer page that are on the display */
+static inline uint8_t page_mask(int page){
+    if(page<0 || page>=RESY_B)
+        return 0;
+    if(page==RESY_B-1 && RESY%8)
+        return (1<<(RESY%8))-1;
+    return 0xff;
+}
+
+/* merge src (only the bits in m) into *d */
+static inline void blit_byte(uint8_t *d, uint8_t src, uint8_t m, uint8_t op){
+    src&=m;
+    switch(op){
+        case BLIT_COPY:
+            *d=(*d&~m)|src;
+            break;
+        case BLIT_OR:
+            *d|=src;
+            break;
+        case BLIT_XOR:
+            *d^=src;
+            break;
+        case BLIT_ANDNOT:
+            *d&=~src;
+            break;
+    };
+}
+
+void lcdBlit(int x, int y, const uint8_t *sprite, int w, int h, uint8_t op){
+    int pages=(h+7)/8;
+    int row0=RESY-y-h;      /* buffer row of sprite row 0 */
+    int col0=RESX-x-w;      /* buffer column of sprite column 0 */
+    int shift=row0&7;       /* also right for negative row0 */
+    int page0=(row0-shift)/8;
+    int cmin=0, cmax=w-1;
+
+    if(col0<0)
+        cmin=-col0;
+    if(col0+cmax>=RESX)
+        cmax=RESX-1-col0;
+    if(cmin>cmax || h<=0)
+        return;
+
+    for(int sp=0;sp<pages;sp++){
+        int page=page0+sp;
+        uint8_t valid=0xff;
+        uint16_t m16;
+        uint8_t mlo,mhi;
+
+        if(sp==pages-1 && h%8)
+            valid=(1<<(h%8))-1;
+        m16=(uint16_t)valid<<shift;
+        mlo=m16&page_mask(page);
+        mhi=(m16>>8)&page_mask(page+1);
+        if(!mlo && !mhi)
+            continue;
+
+        const uint8_t *s=sprite+sp*w+cmin;
+        uint8_t *d=lcdBuffer+page*RESX+col0+cmin;
+        for(int c=cmin;c<=cmax;c++,s++,d++){
+            uint16_t v=(uint16_t)*s<<shift;
+            if(mlo)
+                blit_byte(d,v,mlo,op);
+            if(mhi)
+                blit_byte(d+RESX,v>>8,mhi,op);
+        };
+    };
+    lcdMarkDirty(x,y,x+w-1,y+h-1);
+}
+
+void lcdFillRect(int x0, int y0, int x1, int y1, uint8_t op){
+    int t;
+
+    if(x0>x1){ t=x0; x0=x1; x1=t; };
+    if(y0>y1){ t=y0; y0=y1; y1=t; };
+    if(x0<0) x0=0;
+    if(y0<0) y0=0;
+    if(x1>=RESX) x1=RESX-1;
+    if(y1>=RESY) y1=RESY-1;
+    if(x0>x1 || y0>y1)
+        return;
+
+    int rmin=RESY-1-y1, rmax=RESY-1-y0;
+    int cmin=RESX-1-x1, cmax=RESX-1-x0;
+
+    for(int page=rmin/8;page<=rmax/8;page++){
+        uint8_t m=0xff;
+        if(page==rmin/8)
+            m&=0xff<<(rmin%8);
+        if(page==rmax/8)
+            m&=0xff>>(7-rmax%8);
+
+        uint8_t *d=lcdBuffer+page*RESX+cmin;
+        for(int c=cmin;c<=cmax;c++,d++)
+            blit_byte(d,0xff,m,op);
+    };
+    lcdMarkDirty(x0,y0,x1,y1);
+}
+
+void lcdHLine(int x0, int x1, int y, uint8_t op){
+    lcdFillRect(x0,y,x1,y,op);
+}
+
+void lcdVLine(int x, int y0, int y1, uint8_t op){
+    lcdFillRect(x,y0,x,y1,op);
+}
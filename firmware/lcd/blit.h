@@ -0,0 +1,25 @@
+#ifndef __BLIT_H_
+#define __BLIT_H_
+
+#include <sysdefs.h>
+
+/* Sprites are 1-bpp bitmaps in the layout of lcdBuffer, i.e. a
+ * w*h sprite is a small framebuffer of (h+7)/8 pages of w bytes:
+ * pixel (x,y) is bit (h-1-y)%8 of byte ((h-1-y)/8)*w+(w-1-x).
+ * img2lcd.pl produces this format for images of any size.
+ */
+
+#define BLIT_COPY   0 /* replace the covered area */
+#define BLIT_OR     1 /* set the pixels set in the sprite */
+#define BLIT_XOR    2 /* invert them */
+#define BLIT_ANDNOT 3 /* clear them */
+
+void lcdBlit(int x, int y, const uint8_t *sprite, int w, int h, uint8_t op);
+
+/* Lines and rectangles are inclusive; BLIT_COPY and BLIT_OR set,
+ * BLIT_ANDNOT clears, BLIT_XOR inverts the pixels. */
+void lcdFillRect(int x0, int y0, int x1, int y1, uint8_t op);
+void lcdHLine(int x0, int x1, int y, uint8_t op);
+void lcdVLine(int x, int y0, int y1, uint8_t op);
+
+#endif
@@ -16,18 +16,15 @@
 #define MODE 8 /* 8 or 16 */
 
 #if MODE == 8
-#define putpix(x) _helper_pixel8(x)
 #define px_INIT_MODE 2
 #define px_PACK(r,g,b) COLORPACK_RGB332(r,g,b)
 #define px_type uint8_t
 #else
  #if MODE == 12
- #define putpix(x) _helper_pixel12(x)
  #define px_INIT_MODE 3
  #define px_PACK(r,g,b) COLORPACK_RGB444(r,g,b)
  #define px_type uint16_t
  #else
- #define putpix(x) _helper_pixel16(x)
  #define px_INIT_MODE 5
  #define px_PACK(r,g,b) COLORPACK_RGB565(r,g,b)
  #define px_type uint16_t
@@ -46,6 +43,24 @@ uint8_t displayType;
 #define TYPE_CMD    0
 #define TYPE_DATA   1
 
+/* Dirty tracking: per buffer page the range of buffer columns
+ * changed since the last lcdDisplay(). lo>hi means clean. */
+static uint8_t lcd_dirty_lo[RESY_B];
+static uint8_t lcd_dirty_hi[RESY_B] = { [0 ... RESY_B-1] = RESX-1 };
+static uint8_t lcd_shown_flags=0xff; // mirror/invert of the last push
+
+static inline void lcd_dirty(uint8_t page, uint8_t lo, uint8_t hi){
+    if(lo<lcd_dirty_lo[page])
+        lcd_dirty_lo[page]=lo;
+    if(hi>lcd_dirty_hi[page])
+        lcd_dirty_hi[page]=hi;
+}
+
+static void lcd_clean(void){
+    memset(lcd_dirty_lo,0xff,RESY_B);
+    memset(lcd_dirty_hi,0,RESY_B);
+}
+
 static void lcd_select() {
 #if CFG_USBMSC
     if(usbMSCenabled){
@@ -53,21 +68,15 @@ static void lcd_select() {
         USB_DEVINTEN=0;
     };
 #endif
-    /* the LCD requires 9-Bit frames */
-    uint32_t configReg = ( SSP_SSP0CR0_DSS_9BIT     // Data size = 9-bit
-                  | SSP_SSP0CR0_FRF_SPI             // Frame format = SPI
-                  | SSP_SSP0CR0_SCR_8);             // Serial clock rate = 8
-    SSP_SSP0CR0 = configReg;
+    /* switches the bus to the 9-Bit frames the LCD requires */
+    sspbusAcquire(SSPBUS_LCD);
     gpioSetValue(RB_LCD_CS, 0);
 }
 
 static void lcd_deselect() {
     gpioSetValue(RB_LCD_CS, 1);
-    /* reset the bus to 8-Bit frames that everyone else uses */
-    uint32_t configReg = ( SSP_SSP0CR0_DSS_8BIT     // Data size = 8-bit
-                  | SSP_SSP0CR0_FRF_SPI             // Frame format = SPI
-                  | SSP_SSP0CR0_SCR_8);             // Serial clock rate = 8
-    SSP_SSP0CR0 = configReg;
+    /* back to the 8-Bit frames that everyone else uses */
+    sspbusRelease(SSPBUS_LCD);
 #if CFG_USBMSC
     if(usbMSCenabled){
         USB_DEVINTEN=intstatus;
@@ -86,6 +95,16 @@ static void lcdWrite(uint8_t cd, uint8_t data) {
     while ((SSP_SSP0SR & (SSP_SSP0SR_BSY_BUSY|SSP_SSP0SR_RNE_NOTEMPTY)) != SSP_SSP0SR_RNE_NOTEMPTY);
     /* clear the FIFO */
     frame = SSP_SSP0DR;
+    sspFrames++;
+}
+
+/* let the radio have the bus between two pages of a long update */
+static void lcd_yield() {
+    if(sspbusPending){
+        gpioSetValue(RB_LCD_CS, 1);
+        sspbusYield(SSPBUS_LCD);
+        gpioSetValue(RB_LCD_CS, 0);
+    };
 }
 
 #define CS 2,1
@@ -252,10 +271,29 @@ void lcdInit(void) {
         }
     }
     lcd_deselect();
+    lcdMarkDirtyAll();
+}
+
+void lcdMarkDirtyAll(void){
+    memset(lcd_dirty_lo,0,RESY_B);
+    memset(lcd_dirty_hi,RESX-1,RESY_B);
+}
+
+/* rectangle in screen coordinates, inclusive */
+void lcdMarkDirty(int x0, int y0, int x1, int y1){
+    if(x0<0) x0=0;
+    if(y0<0) y0=0;
+    if(x1>=RESX) x1=RESX-1;
+    if(y1>=RESY) y1=RESY-1;
+    if(x0>x1 || y0>y1)
+        return;
+    for(int page=(RESY-(y1+1))/8;page<=(RESY-(y0+1))/8;page++)
+        lcd_dirty(page,RESX-(x1+1),RESX-(x0+1));
 }
 
 void lcdFill(char f){
     memset(lcdBuffer,f,RESX*RESY_B);
+    lcdMarkDirtyAll();
 #if 0
     int x;
     for(x=0;x<RESX*RESY_B;x++) {
@@ -276,6 +314,8 @@ void lcdSetPixel(char x, char y, bool f){
         byte &= ~(1 << y_off);
     }
     lcdBuffer[y_byte*RESX+(RESX-(x+1))] = byte;
+    if (x<RESX && y<RESY)
+        lcd_dirty(y_byte,RESX-(x+1),RESX-(x+1));
 }
 
 bool lcdGetPixel(char x, char y){
@@ -285,29 +325,6 @@ bool lcdGetPixel(char x, char y){
     return byte & (1 << y_off);
 }
 
-// Color display helper functions
-static inline void _helper_pixel8(uint8_t color1){
-    lcdWrite(TYPE_DATA, color1);
-}
-
-static void _helper_pixel12(uint16_t color){
-    static char odd=0;
-    static char rest;
-    if(odd){
-        lcdWrite(TYPE_DATA,(rest<<4) | (color>>8));
-        lcdWrite(TYPE_DATA,color&0xff);
-    }else{
-        lcdWrite(TYPE_DATA,(color>>4)&0xff);
-        rest=(color&0x0f);
-    };
-    odd=1-odd;
-}
-
-static void _helper_pixel16(uint16_t color){
-    lcdWrite(TYPE_DATA,color>>8);
-    lcdWrite(TYPE_DATA,color&0xFF);
-}
-
 #define COLORPACK_RGB565(r,g,b) (((r&0xF8) << 8) | ((g&0xFC)<<3) | ((b&0xF8) >> 3))
 #define COLORPACK_RGB444(r,g,b) ( ((r&0xF0)<<4) | (g&0xF0) | ((b&0xF0)>>4) )
 #define COLORPACK_RGB332(r,g,b) ( (((r>>5)&0x7)<<5) | (((g>>5)&0x7)<<2) | ((b>>6)&0x3) )
@@ -315,49 +332,246 @@ static void _helper_pixel16(uint16_t color){
 static const px_type COLOR_FG =   px_PACK(0x00, 0x00, 0x00);
 static const px_type COLOR_BG =   px_PACK(0xff, 0xff, 0xff);
 
-void lcdDisplay(void) {
-    char byte;
-    lcd_select();
+/* The N1600 is written row by row, but lcdBuffer holds 8 rows per
+ * byte. Four buffer columns of a row are gathered into a nibble
+ * (bit 3 = lowest column) and expanded through a lookup table into
+ * the frames for those 4 pixels, already in panel order and colour.
+ * The table is built on the stack for every rectangle, that is cheap
+ * next to sending it and keeps it out of .bss.
+ */
+#define LUT_FRAMES (MODE/2) /* 9-bit frames per 4 pixels */
+
+static void lcd_lut_init(uint16_t lut[16][LUT_FRAMES], uint8_t flags){
+    px_type fg=COLOR_FG, bg=COLOR_BG, px[4];
+    uint16_t *f;
+
+    if(flags & LCD_INVERTED){
+        fg=COLOR_BG;
+        bg=COLOR_FG;
+    };
+    for(int n=0;n<16;n++){
+        /* mirrored, the panel walks the buffer columns backwards */
+        for(int i=0;i<4;i++)
+            px[i]=(n>>((flags & LCD_MIRRORX)?i:3-i))&1 ? fg : bg;
+        f=lut[n];
+#if MODE == 8
+        for(int i=0;i<4;i++)
+            *f++=(TYPE_DATA<<8)|px[i];
+#elif MODE == 12
+        for(int i=0;i<4;i+=2){
+            *f++=(TYPE_DATA<<8)|((px[i]>>4)&0xff);
+            *f++=(TYPE_DATA<<8)|((px[i]&0x0f)<<4)|(px[i+1]>>8);
+            *f++=(TYPE_DATA<<8)|(px[i+1]&0xff);
+        };
+#else
+        for(int i=0;i<4;i++){
+            *f++=(TYPE_DATA<<8)|(px[i]>>8);
+            *f++=(TYPE_DATA<<8)|(px[i]&0xff);
+        };
+#endif
+    };
+}
+
+/* Write buffer columns cmin..cmax (multiples of 4), panel rows
+ * rmin..rmax */
+static void lcd_rect_n1600(const uint8_t *buf, int cmin, int cmax,
+        int rmin, int rmax, uint8_t flags){
+    uint16_t lut[16][LUT_FRAMES];
+    uint16_t frames[RESX/4*LUT_FRAMES];
+    uint16_t *f;
+    uint32_t w;
+    int bc, step, end, r;
+
+    lcd_lut_init(lut,flags);
+
+    if(flags & LCD_MIRRORX){
+        lcdWrite(TYPE_CMD,0x2A);
+        lcdWrite(TYPE_DATA,1+RESX-1-cmax);
+        lcdWrite(TYPE_DATA,1+RESX-1-cmin);
+        bc=cmax-3; end=cmin-4; step=-4;
+    }else{
+        lcdWrite(TYPE_CMD,0x2A);
+        lcdWrite(TYPE_DATA,1+cmin);
+        lcdWrite(TYPE_DATA,1+cmax);
+        bc=cmin; end=cmax+1; step=4;
+    };
+    lcdWrite(TYPE_CMD,0x2B);
+    lcdWrite(TYPE_DATA,1+rmin);
+    lcdWrite(TYPE_DATA,1+rmax);
+    lcdWrite(TYPE_CMD,0x2C);
+
+    for(r=rmin;r<=rmax;r++){
+        const uint8_t *row=buf+(r/8)*RESX;
+        uint8_t bit=r%8;
+
+        f=frames;
+        for(int c=bc;c!=end;c+=step){
+            memcpy(&w,row+c,4); /* 4 page-bytes, little endian */
+            w=((w>>bit)&0x01010101)*0x08040201;
+            memcpy(f,lut[(w>>24)&0xf],sizeof(lut[0]));
+            f+=LUT_FRAMES;
+        };
+        sspSend16(0,frames,f-frames);
+        lcd_yield();
+    };
+}
 
+/* Send columns lo..hi of one buffer page. The panel is addressed in
+ * buffer order: panel column == buffer column (unless mirrored),
+ * N1200 page == buffer page, N1600 row == page*8+bit.
+ */
+static void lcd_push_page(const uint8_t *buf, uint8_t page,
+        uint16_t lo, uint16_t hi, uint8_t flags) {
     if(displayType==DISPLAY_N1200){
-      lcdWrite(TYPE_CMD,0xB0);
-      lcdWrite(TYPE_CMD,0x10);
-      lcdWrite(TYPE_CMD,0x00);
-      uint16_t i,page;
-      for(page=0; page<RESY_B;page++) {
-          for(i=0; i<RESX; i++) {
-              if (GLOBAL(lcdmirror))
-                  byte=lcdBuffer[page*RESX+RESX-1-(i)];
-              else
-                  byte=lcdBuffer[page*RESX+(i)];
+      uint16_t i;
+      uint8_t byte;
+      uint16_t frames[RESX];
+
+      if (flags & LCD_MIRRORX){
+          i=lo;
+          lo=RESX-1-hi;
+          hi=RESX-1-i;
+      };
+      lcdWrite(TYPE_CMD,0xB0|page);
+      lcdWrite(TYPE_CMD,0x10|(lo>>4));
+      lcdWrite(TYPE_CMD,0x00|(lo&0xf));
+      for(i=lo; i<=hi; i++) {
+          if (flags & LCD_MIRRORX)
+              byte=buf[page*RESX+RESX-1-(i)];
+          else
+              byte=buf[page*RESX+(i)];
   
-              if (GLOBAL(lcdinvert))
-                  byte=~byte;
+          if (flags & LCD_INVERTED)
+              byte=~byte;
       
-              lcdWrite(TYPE_DATA,byte);
-          }
+          frames[i-lo]=(TYPE_DATA<<8)|byte;
       }
+      /* one page at a time through the SSP FIFO */
+      sspSend16(0,frames,hi-lo+1);
     } else { /* displayType==DISPLAY_N1600 */
-      uint16_t x,y;
-      bool px;
- 
-      lcdWrite(TYPE_CMD,0x2C);
-  
-      for(y=RESY;y>0;y--){
-          for(x=RESX;x>0;x--){
-              if(GLOBAL(lcdmirror))
-                  px=lcdGetPixel(RESX-x,y-1);
-              else
-                  px=lcdGetPixel(x-1,y-1);
-
-	      if((!px)^(!GLOBAL(lcdinvert))) {
-		      putpix(COLOR_FG); /* foreground */
-	      } else {
-		      putpix(COLOR_BG); /* background */
-	      }
-          }
-      }
+      uint16_t rmax=page*8+7;
+      if(rmax>=RESY)
+          rmax=RESY-1;
+      lcd_rect_n1600(buf,lo&~3,hi|3,page*8,rmax,flags);
+    };
+}
+
+static uint8_t lcd_flags(void) {
+    uint8_t flags=(GLOBAL(lcdmirror)?LCD_MIRRORX:0)|(GLOBAL(lcdinvert)?LCD_INVERTED:0);
+
+    if(flags!=lcd_shown_flags){
+        lcd_shown_flags=flags;
+        lcdMarkDirtyAll();
+    };
+    return flags;
+}
+
+#if LCD_FRONTBUFFER
+/* Double buffering: lcdPresent() copies lcdBuffer to the front buffer
+ * and a work queue job sends it one dirty page per step. */
+static uint8_t *lcd_front=NULL;
+static uint8_t lcd_front_lo[RESY_B] = { [0 ... RESY_B-1] = 0xff };
+static uint8_t lcd_front_hi[RESY_B];
+static uint8_t lcd_front_flags;
+static uint8_t lcd_front_queued=0;
+
+/* send the next dirty page of the front buffer, 0 if there is none */
+static int lcd_present_page(void) {
+    uint8_t page;
+
+    for(page=0; page<RESY_B; page++)
+        if(lcd_front_lo[page]<=lcd_front_hi[page])
+            break;
+    if(page==RESY_B)
+        return 0;
+
+    lcd_select();
+    lcd_push_page(lcd_front,page,lcd_front_lo[page],lcd_front_hi[page],
+            lcd_front_flags);
+    lcd_deselect();
+    lcd_front_lo[page]=0xff;
+    lcd_front_hi[page]=0;
+    return 1;
+}
+
+static uint8_t lcd_present_job(uint8_t state) {
+    if(lcd_present_page())
+        return state+1 < QS_END ? state+1 : 1;
+    lcd_front_queued=0;
+    return QS_END;
+}
+
+bool lcdFrameDone(void) {
+    for(uint8_t page=0; page<RESY_B; page++)
+        if(lcd_front_lo[page]<=lcd_front_hi[page])
+            return false;
+    return true;
+}
+
+void lcdPresent(void) {
+    if(lcd_front==NULL){
+        lcdDisplay();
+        return;
+    };
+
+    /* the previous frame has to be out before we overwrite it */
+    while(lcd_present_page());
+
+    memcpy(lcd_front,lcdBuffer,RESX*RESY_B);
+    lcd_front_flags=lcd_flags();
+    memcpy(lcd_front_lo,lcd_dirty_lo,RESY_B);
+    memcpy(lcd_front_hi,lcd_dirty_hi,RESY_B);
+    lcd_clean();
+
+    if(!lcd_front_queued){
+        if(push_queue_plus(&lcd_present_job)==0)
+            lcd_front_queued=1;
+        else
+            while(lcd_present_page()); // queue full: do it now
+    };
+}
+
+/* front must hold RESX*RESY_B bytes and stay valid until
+ * lcdSetFrontBuffer(NULL) */
+void lcdSetFrontBuffer(uint8_t *front) {
+    if(lcd_front!=NULL)
+        while(lcd_present_page());
+    lcd_front=front;
+}
+#else /* LCD_FRONTBUFFER */
+bool lcdFrameDone(void) {
+    return true;
+}
+
+void lcdPresent(void) {
+    lcdDisplay();
+}
+
+void lcdSetFrontBuffer(uint8_t *front) {
+}
+#endif /* LCD_FRONTBUFFER */
+
+void lcdDisplay(void) {
+    uint8_t flags;
+
+#if LCD_FRONTBUFFER
+    if(lcd_front!=NULL){ /* keep the frames in order */
+        lcdPresent();
+        while(lcd_present_page());
+        return;
+    };
+#endif
+
+    flags=lcd_flags();
+    lcd_select();
+    for(uint8_t page=0; page<RESY_B;page++) {
+        if(lcd_dirty_lo[page]>lcd_dirty_hi[page])
+            continue;
+        lcd_push_page(lcdBuffer,page,lcd_dirty_lo[page],lcd_dirty_hi[page],
+                flags);
+        lcd_yield();
     };
+    lcd_clean();
     lcd_deselect();
 }
 
@@ -397,92 +611,122 @@ void __attribute__((__deprecated__)) lcdToggleFlag(int flag) {
         GLOBAL(lcdinvert)=!GLOBAL(lcdinvert);
 }
 
-void lcdShiftH(bool right, bool wrap) {
-	uint8_t tmp;
-	for (int yb = 0; yb<RESY_B; yb++) {
-		if (right) {
-			tmp = lcdBuffer[yb*RESX];
-			memmove(lcdBuffer + yb*RESX,lcdBuffer + yb*RESX+1 ,RESX-1);
-            lcdBuffer[yb*RESX+(RESX-1)] = wrap?tmp:0;
-		} else {
-			tmp = lcdBuffer[yb*RESX+(RESX-1)];
-			memmove(lcdBuffer + yb*RESX+1,lcdBuffer + yb*RESX ,RESX-1);
-			lcdBuffer[yb*RESX] = wrap?tmp:0;
-		}
-	}
-}
-
-void lcdShiftV8(bool up, bool wrap) {
-	uint8_t tmp[RESX];
-	if (!up) {
-		if (wrap)
-            memmove(tmp, lcdBuffer, RESX);
-        else
-            memset(tmp,0,RESX);
-		memmove(lcdBuffer,lcdBuffer+RESX ,RESX*(RESY_B-1));
-		memmove(lcdBuffer+RESX*(RESY_B-1),tmp,RESX);
-	} else {
-		if (wrap)
-            memmove(tmp, lcdBuffer+RESX*(RESY_B-1), RESX);
-        else
-            memset(tmp,0,RESX);
-		memmove(lcdBuffer+RESX,lcdBuffer ,RESX*(RESY_B-1));
-		memmove(lcdBuffer,tmp,RESX);
-	}
+/* Shifting works on whole rows of bytes horizontally. Vertically it
+ * takes four columns at a time: one 32 bit word per page holds their
+ * bytes, and bits move between pages with per-byte masks.
+ */
+#define BYTES(b) (0x01010101UL*(uint8_t)(b))
+#define LASTPAGE BYTES(0xff>>(8*RESY_B-RESY)) /* rows on the last page */
+
+static void lcd_shift_h(int x, bool wrap) {
+    uint8_t tmp[RESX];
+    uint8_t *row;
+
+    if(wrap){
+        x%=RESX;
+        if(x<0)
+            x+=RESX;
+    }else if(x>=RESX || x<=-RESX){
+        memset(lcdBuffer,0,RESX*RESY_B);
+        return;
+    };
+
+    for(int page=0; page<RESY_B; page++){
+        row=lcdBuffer+page*RESX;
+        if(wrap){ /* right by x */
+            memcpy(tmp,row,x);
+            memmove(row,row+x,RESX-x);
+            memcpy(row+RESX-x,tmp,x);
+        }else if(x>0){
+            memmove(row,row+x,RESX-x);
+            memset(row+RESX-x,0,x);
+        }else{
+            memmove(row-x,row,RESX+x);
+            memset(row,0,-x);
+        };
+    };
 }
 
-void lcdShiftV(bool up, bool wrap) {
-	uint8_t tmp[RESX];
-	if (up) {
-		if (wrap) 
-            memmove(tmp,lcdBuffer+((RESY_B-1)*RESX),RESX);
-        else
-            memset(tmp,0,RESX);
-		for (int x = 0; x<RESX; x++){
-			for (int y = RESY_B-1; y > 0; y--){
-				lcdBuffer[x+(y*RESX)] = (lcdBuffer[x+(y*RESX)] << 1) |( lcdBuffer[x+((y-1)*RESX)] >> 7);
-			}
-			lcdBuffer[x] = ( lcdBuffer[x] << 1) | ((tmp[x]>>3)&1);
-		}
-				
-	} else {
-		if (wrap)
-            memmove(tmp,lcdBuffer,RESX);
+/* move the rows of w up (towards y=0) by n, 0<=n<=RESY */
+static void lcd_shift_up(const uint32_t *w, uint32_t *out, int n) {
+    int q=n/8, s=n%8;
+    uint32_t a,b;
+
+    for(int p=0; p<RESY_B; p++){
+        a=(p-q>=0)  ?w[p-q]  :0;
+        b=(p-q-1>=0)?w[p-q-1]:0;
+        if(s)
+            out[p]=((a<<s)&BYTES(0xff<<s)) | ((b>>(8-s))&BYTES(0xff>>(8-s)));
         else
-            memset(tmp,0,RESX);
-		for (int x = 0; x<RESX; x++){
-			for (int y = 0; y < (RESY_B-1); y++){
-				lcdBuffer[x+(y*RESX)] = (lcdBuffer[x+(y*RESX)] >> 1) |( lcdBuffer[x+((y+1)*RESX)] << 7);
-			}
-			lcdBuffer[x+((RESY_B-1)*RESX)] = ( lcdBuffer[x+((RESY_B-1)*RESX)] >> 1) | ((tmp[x]<<3)&8);
-		}	
-	}
-}	
+            out[p]=a;
+    };
+    out[RESY_B-1]&=LASTPAGE;
+}
 
-void lcdShift(int x, int y, bool wrap) {
-	bool dir=true;
+static void lcd_shift_down(const uint32_t *w, uint32_t *out, int n) {
+    int q=n/8, s=n%8;
+    uint32_t a,b;
 
-    if(x<0){
-        dir=false;
-        x=-x;
+    for(int p=0; p<RESY_B; p++){
+        a=(p+q<RESY_B)  ?w[p+q]  :0;
+        b=(p+q+1<RESY_B)?w[p+q+1]:0;
+        if(s)
+            out[p]=((a>>s)&BYTES(0xff>>s)) | ((b<<(8-s))&BYTES(0xff<<(8-s)));
+        else
+            out[p]=a;
     };
+}
 
-    while(x-->0)
-        lcdShiftH(dir, wrap);
+static void lcd_shift_v(int y, bool wrap) {
+    uint32_t w[RESY_B], out[RESY_B], tmp[RESY_B];
 
-    if(y<0){
-        dir=false;
-        y=-y;
-    }else{
-        dir=true;
+    if(wrap){
+        y%=RESY;
+        if(y<0)
+            y+=RESY;
+    }else if(y>=RESY || y<=-RESY){
+        memset(lcdBuffer,0,RESX*RESY_B);
+        return;
+    }else if(y%8==0){ /* whole pages */
+        if(y>0){
+            memmove(lcdBuffer+y/8*RESX,lcdBuffer,(RESY_B-y/8)*RESX);
+            memset(lcdBuffer,0,y/8*RESX);
+        }else{
+            memmove(lcdBuffer,lcdBuffer-y/8*RESX,(RESY_B+y/8)*RESX);
+            memset(lcdBuffer+(RESY_B+y/8)*RESX,0,-y/8*RESX);
+        };
+        for(int c=0; c<RESX; c++)
+            lcdBuffer[(RESY_B-1)*RESX+c]&=(uint8_t)LASTPAGE;
+        return;
     };
 
-    while(y>=8){
-        y-=8;
-        lcdShiftV8(dir, wrap);
+    for(int c=0; c<RESX; c+=4){
+        for(int p=0; p<RESY_B; p++)
+            memcpy(&w[p],lcdBuffer+p*RESX+c,sizeof(uint32_t));
+        w[RESY_B-1]&=LASTPAGE;
+
+        if(wrap){
+            lcd_shift_up(w,out,y);
+            lcd_shift_down(w,tmp,RESY-y);
+            for(int p=0; p<RESY_B; p++)
+                out[p]|=tmp[p];
+        }else if(y>0){
+            lcd_shift_up(w,out,y);
+        }else{
+            lcd_shift_down(w,out,-y);
+        };
+
+        for(int p=0; p<RESY_B; p++)
+            memcpy(lcdBuffer+p*RESX+c,&out[p],sizeof(uint32_t));
     };
+}
 
-    while(y-->0)
-        lcdShiftV(dir, wrap);
+/* x>0: right, y>0: up. Each direction is done in one pass. */
+void lcdShift(int x, int y, bool wrap) {
+    lcdMarkDirtyAll();
+    if(x)
+        lcd_shift_h(x,wrap);
+    if(y)
+        lcd_shift_v(y,wrap);
 }
 
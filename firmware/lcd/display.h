@@ -30,6 +30,17 @@ void lcdSetPixel(char x, char y, bool f);
 //void lcdSafeSetPixel(char x, char y, bool f);  //useless. see in display.c to learn why --the_nihilant
 bool lcdGetPixel(char x, char y);
 void lcdShift(int x, int y, bool wrap);
+void lcdMarkDirty(int x0, int y0, int x1, int y1);
+void lcdMarkDirtyAll(void);
+/* Double buffering is off unless the build sets LCD_FRONTBUFFER to 1.
+ * Without it lcdPresent() is lcdDisplay() and the front buffer is not
+ * used, the functions stay for the l0dable table. */
+#ifndef LCD_FRONTBUFFER
+#define LCD_FRONTBUFFER 0
+#endif
+void lcdSetFrontBuffer(uint8_t *front);
+void lcdPresent(void);
+bool lcdFrameDone(void);
 void lcdSetContrast(int c);
 void lcdSetInvert();
 #endif
@@ -1,11 +1,15 @@
 #include <sysinit.h>
+#include <string.h>
 
 #include "basic/basic.h"
 #include "lcd/lcd.h"
 #include "lcd/display.h"
 #include "filesystem/ff.h"
+#include "filesystem/extent.h"
+#include "filesystem/at45db041d.h"
 
 int lcdLoadImage(char *file) {
+    lcdMarkDirtyAll();
     return readFile(file,(char *)lcdBuffer,RESX*RESY_B);
 }
 
@@ -13,25 +17,182 @@ int lcdSaveImage(char *file) {
 	return writeFile(file,(char *)lcdBuffer,RESX*RESY_B);
 }
 
+/* lcdShowAnim() plays raw files (lcdBuffer images back to back) and
+ * delta compressed ones, made by tools/image/lcdanim.pl. All numbers
+ * little endian:
+ *
+ *  'r' '0' 'A' ANIM_VERSION  magic
+ *  u16 frames
+ *  u16 framems               0: use the one passed to lcdShowAnim
+ *  u16 keys
+ *  u16 reserved
+ *  u32 offset[keys]          file offset of each keyframe
+ *
+ * then per frame: u8 flags, u16 length, length bytes of codes. The
+ * codes describe the XOR of the frame with the previous one (with an
+ * empty screen for ANIM_KEY frames), in lcdBuffer order; bytes after
+ * the last code are unchanged:
+ *
+ *  0x00-0x7f  skip n+1 bytes
+ *  0x80-0xbf  n-0x7f bytes follow, XOR them in
+ *  0xc0-0xff  one byte follows, XOR it into the next n-0xbf bytes
+ *
+ * The first frame is a keyframe; playback loops to offset[0].
+ */
+#define ANIM_VERSION 1
+#define ANIM_KEY     (1<<0)
+#define ANIM_HEADER  12
+#define ANIM_CHUNK   64
+
+struct anim_in {
+    FIL *file;          /* NULL: contiguous, read ext from the flash */
+    EXTENT ext;
+    DWORD fpos;         /* file offset after buf */
+    UINT len;
+    UINT pos;
+    uint8_t buf[ANIM_CHUNK];
+};
+
+static int anim_fill(struct anim_in *in){
+    in->pos=0;
+    if(in->file)
+        return f_read(in->file, in->buf, ANIM_CHUNK, &in->len)==FR_OK && in->len;
+    in->len=in->fpos<in->ext.size?in->ext.size-in->fpos:0;
+    if(in->len>ANIM_CHUNK)
+        in->len=ANIM_CHUNK;
+    if(!in->len || dataflash_random_read(in->buf, in->ext.offset+in->fpos, in->len)){
+        in->len=0;
+        return 0;
+    };
+    in->fpos+=in->len;
+    return 1;
+}
+
+static int anim_getc(struct anim_in *in){
+    if(in->pos==in->len && !anim_fill(in))
+        return -1;
+    return in->buf[in->pos++];
+}
+
+static UINT anim_read(struct anim_in *in, uint8_t *dst, UINT n){
+    UINT got=0, chunk;
+
+    while(got<n){
+        if(in->pos==in->len && !anim_fill(in))
+            break;
+        chunk=in->len-in->pos;
+        if(chunk>n-got)
+            chunk=n-got;
+        memcpy(dst+got, in->buf+in->pos, chunk);
+        in->pos+=chunk;
+        got+=chunk;
+    };
+    return got;
+}
+
+static int anim_seek(struct anim_in *in, DWORD ofs){
+    in->pos=in->len=0;
+    if(in->file)
+        return f_lseek(in->file, ofs);
+    in->fpos=ofs;
+    return FR_OK;
+}
+
+/* mark lcdBuffer bytes from..to-1 dirty */
+static void anim_dirty(int from, int to){
+    for(int page=from/RESX;page<=(to-1)/RESX;page++){
+        int c0=from-page*RESX, c1=to-1-page*RESX;
+        if(c0<0) c0=0;
+        if(c1>=RESX) c1=RESX-1;
+        lcdMarkDirty(RESX-1-c1, RESY-8-8*page, RESX-1-c0, RESY-1-8*page);
+    };
+}
+
+/* Decode one frame record into lcdBuffer, 0 on success */
+static int anim_frame(struct anim_in *in){
+    int flags, len, c, b, n;
+    int pos=0;
+
+    if((flags=anim_getc(in))<0 || (len=anim_getc(in))<0 || (c=anim_getc(in))<0)
+        return -1;
+    len|=c<<8;
+
+    if(flags&ANIM_KEY){
+        memset(lcdBuffer,0,RESX*RESY_B);
+        lcdMarkDirtyAll();
+    };
+    while(len>0){
+        if((c=anim_getc(in))<0)
+            return -1;
+        len--;
+        if(c<0x80){
+            pos+=c+1;
+            continue;
+        };
+        n=(c&0x3f)+1;
+        if(pos+n>RESX*RESY_B)
+            return -1;
+        if(c>=0xc0){
+            if((b=anim_getc(in))<0)
+                return -1;
+            len--;
+            for(int i=pos;i<pos+n;i++)
+                lcdBuffer[i]^=b;
+        }else{
+            for(int i=pos;i<pos+n;i++){
+                if((b=anim_getc(in))<0)
+                    return -1;
+                lcdBuffer[i]^=b;
+            };
+            len-=n;
+        };
+        anim_dirty(pos,pos+n);
+        pos+=n;
+    };
+    return 0;
+}
+
 uint8_t lcdShowAnim(char *fname, uint32_t framems) {
     FIL file;            /* File object */
 	int res;
-    UINT readbytes;
 	uint8_t state=0;
+    struct anim_in in;
+    uint8_t hdr[ANIM_HEADER+4];
+    DWORD loop=0;        /* first keyframe, 0 for raw files */
 
-	res=f_open(&file, fname, FA_OPEN_EXISTING|FA_READ);
-	if(res)
-		return 1;
+    in.file=NULL;
+    if(fileExtent(fname, &in.ext)){
+        res=f_open(&file, fname, FA_OPEN_EXISTING|FA_READ);
+        if(res)
+            return 1;
+        in.file=&file;
+    };
+    anim_seek(&in,0);
+
+    if(anim_read(&in, hdr, sizeof(hdr))==sizeof(hdr) && hdr[0]=='r'
+            && hdr[1]=='0' && hdr[2]=='A' && hdr[3]==ANIM_VERSION){
+        if(hdr[6]|hdr[7])
+            framems=hdr[6]|hdr[7]<<8;
+        loop=hdr[12]|hdr[13]<<8|(DWORD)hdr[14]<<16|(DWORD)hdr[15]<<24;
+    };
+    anim_seek(&in,loop);
 
 	getInputWaitRelease();
 	while(!getInputRaw()){
-//        lcdFill(0x55);  // useless, as it will be overwritten anyway by the next instruction  --the_nihilant
-		res = f_read(&file, (char *)lcdBuffer, RESX*RESY_B, &readbytes);
-        if(res)
-            return -1;
-		if(readbytes<RESX*RESY_B){
-			f_lseek(&file,0);
-            continue;
+        if(loop){
+            /* at the end (or on a broken frame) start over */
+            res=anim_frame(&in);
+            if(res && anim_seek(&in,loop)==FR_OK)
+                res=anim_frame(&in);
+            if(res)
+                return -1;
+        }else{
+//            lcdFill(0x55);  // useless, as it will be overwritten anyway by the next instruction  --the_nihilant
+            if(anim_read(&in, lcdBuffer, RESX*RESY_B)<RESX*RESY_B){
+                anim_seek(&in,0);
+                continue;
+            };
+            lcdMarkDirtyAll();
         };
 		lcdDisplay();
         if(framems<100){
@@ -46,5 +207,3 @@ uint8_t lcdShowAnim(char *fname, uint32_t framems) {
 
     return 0;
 }
-
-
@@ -1,6 +1,7 @@
 #include "lcd/backlight.h"
 #include "lcd/decoder.h"
 #include "lcd/display.h"
+#include "lcd/blit.h"
 #include "lcd/render.h"
 #include "lcd/fonts/smallfonts.h"
 #include "lcd/o.h"
@@ -37,7 +37,9 @@
 #define O_ENABLE_FILL
 //#define O_ENABLE_STROKE
 #define O_ENABLE_USER_SHADER
-#define O_ENABLE_BW   /* pick one ,. */
+#if !defined(O_ENABLE_GRAY) && !defined(O_ENABLE_GRAY_EXTRA)
+#define O_ENABLE_BW   /* pick one ,. (or -DO_ENABLE_GRAY...) */
+#endif
 //#define O_ENABLE_GRAY
 //#define O_ENABLE_GRAY_EXTRA
 //#define O_ENABLE_RECTANGLE
@@ -71,7 +73,7 @@
 
 
 #define BEZIER_SEGMENTS    16
-#define MAX_SPANS_PER_LINE 7                    /* maximum number of intersecting spans on one line */
+#define MAX_EDGES          24                   /* edge table for o_fill, on the stack; bigger paths are filled in bands */
 #define SPP                10                   /* sup pixel precision divider, each pixel is 6 such units internally */
 #define STACK_DEPTH        3                    /* needs O_ENABLE_STACK */
 #define FONT_PATH          "/tmp/font.bin"      /* if O_ENABLE_EXTERNAL_FONT */
@@ -143,6 +145,49 @@ struct _Path
 static Path *path = NULL;
 
 
+/* spans of the built-in shaders are written directly into lcdBuffer:
+ * screen row y is bit (RESY-1-y)%8 of page (RESY-1-y)/8, and the
+ * columns are mirrored. returns 0 if the shader needs per pixel calls.
+ */
+static int o_span_fast (int x0, int y, int x1, void *shader_data)
+{
+  int      value = (int)(intptr_t)(shader_data);
+  int      row   = RESY-1-y;
+  uint8_t  bit   = 1 << (row % 8);
+  uint8_t *p     = lcdBuffer + (row / 8) * RESX + (RESX - x1);
+  uint8_t *end   = lcdBuffer + (row / 8) * RESX + (RESX - x0);
+
+#if defined(O_ENABLE_BW)
+  if (value)
+    for (; p < end; p++)
+      *p |= bit;
+  else
+    for (; p < end; p++)
+      *p &= ~bit;
+#elif defined(O_ENABLE_GRAY)
+  if (value >= 3)
+    for (; p < end; p++)
+      *p |= bit;
+  else if (value <= 0)
+    for (; p < end; p++)
+      *p &= ~bit;
+  else
+    { /* checkerboard: set where x+y is odd. p is column x1-1, and
+         x decreases along the row */
+      int on = (x1 - 1 + y) & 1;
+      for (; p < end; p++, on ^= 1)
+        if (on)
+          *p |= bit;
+        else
+          *p &= ~bit;
+    }
+#else
+  return 0;
+#endif
+  lcdMarkDirty (x0, y, x1-1, y);
+  return 1;
+}
+
 /* the actual inner draw function used for doing the real painting */
 static void o_render_span(int x0, int y,
                           int x1,
@@ -160,6 +205,13 @@ static void o_render_span(int x0, int y,
 #endif
   if (y <0 || y>=HEIGHT)
     return;
+  if (x0 >= x1)
+    return;
+#ifdef O_ENABLE_USER_SHADER
+  if (shader == shader_gray)
+#endif
+    if (o_span_fast (x0, y, x1, shader_data))
+      return;
   for(int x=x0; x<x1; x++)
     {
 #ifdef O_ENABLE_USER_SHADER
@@ -733,151 +785,217 @@ o_stroke (void)
 
 #ifdef O_ENABLE_FILL
 
-#define EMPTY_SCAN_SLOT -126
+/* Scanline fill with an edge table and an active edge list, even-odd
+ * rule. Pixels are sampled at their centres, edges are stepped
+ * exactly in SPP units with a remainder. Edges are kept sorted by
+ * their first row; when the table is full the edges starting lowest
+ * are dropped and the rows above them are filled first, then the
+ * path is walked again for the rest (a band).
+ */
+typedef struct _Edge Edge;
+struct _Edge
+{
+  short int      ytop;   /* first row */
+  short int      ybot;   /* row after the last */
+  int            x;      /* at the current row, SPP units, rounded down */
+  int            q;      /* x step per row */
+  unsigned short err;    /* x fraction: err/dy */
+  unsigned short r;      /* fraction step per row: r/dy */
+  unsigned short dy;
+};
 
-/* insertion sort integer into array */
-static void insert_sorted (signed char *array, int value)
+typedef struct
 {
-  for (int j=0; j<MAX_SPANS_PER_LINE; j++)
-    {
-      if (array[j] == EMPTY_SCAN_SLOT)
-        {
-          array[j] = value;
-          return;
-        }
-      if (array[j] > value)
-        {
-          for (int k=MAX_SPANS_PER_LINE -1; k >= j+1; k--)
-            array[k] = array[k-1];
-          array[j] = value;
-          return;
-        }
-    }
+  Edge *edges;
+  int   count;
+  int   band;          /* first row of this band */
+  int   stop;          /* rows from here on are in a later band */
+} EdgeTable;
+
+/* index of the first pixel whose centre is at or after v (SPP units) */
+static int o_ceil_px (int v)
+{
+  v -= SPP/2;
+  return v >= 0 ? (v + SPP - 1) / SPP : -((-v) / SPP);
 }
 
-static void fill_line (int prev_x, int prev_y, int dest_x, int dest_y,
-                       signed char scanlines[HEIGHT][MAX_SPANS_PER_LINE],
-                       int *lastdir, int *lastline)
+/* a = q*d + r with 0 <= r < d */
+static int o_floor_div (int a, int d, int *r)
 {
-  int ydir;
-  int dx, dy;
-  dx = dest_x - prev_x;
-  dy = dest_y - prev_y;
-
-  ydir = (dy < 0) ? -1 : 1;
-
-  /* do linear interpolation between vertexes */
-  for (int y = prev_y; y != dest_y; y += ydir)
-    if (y >= 0 && y < HEIGHT && *lastline != y)
-      {
-        int x = prev_x + (dx * (y-prev_y)) / dy;
-        insert_sorted(&scanlines[y][0], x);
-        if (ydir != *lastdir) // && *lastdir != -2)  //XXX: ugly optimizing hack
-          insert_sorted(&scanlines[y][0], x);
-
-        *lastdir = ydir;
-        *lastline = y;
-      }
+  int q = a / d;
+  if (a % d < 0)
+    q--;
+  *r = a - q*d;
+  return q;
 }
 
-void o_fill (void)
+static void o_add_edge (EdgeTable *et, int x0, int y0, int x1, int y1)
 {
-  if (path->count < 1)
+  Edge e;
+  int  t, qa, ra;
+
+  if (y0 == y1)
+    return;
+  if (y0 > y1)
+    {
+      t = x0; x0 = x1; x1 = t;
+      t = y0; y0 = y1; y1 = t;
+    }
+  e.ytop = o_ceil_px (y0);
+  e.ybot = o_ceil_px (y1);
+  if (e.ytop < et->band)
+    e.ytop = et->band;
+  if (e.ybot > HEIGHT)
+    e.ybot = HEIGHT;
+  if (e.ytop >= e.ybot || e.ytop >= et->stop)
     return;
 
-  {
-    signed char scanlines[HEIGHT][MAX_SPANS_PER_LINE];
-    /* Stack allocated scanline intersection list  */
-    Node *iter;
-    int   prev_x,  prev_y;
-    int   first_x, first_y;
-    int   lastline = -1;
-    int   lastdir  = -2;
+  /* x at the centre of row ytop, t SPP units below y0 */
+  e.dy = y1 - y0;
+  t  = e.ytop * SPP + SPP/2 - y0;
+  qa = o_floor_div (x1 - x0, e.dy, &ra);
+  e.x   = x0 + t * qa + (unsigned)t * ra / e.dy;
+  e.err = (unsigned)t * ra % e.dy;
+  e.q   = o_floor_div ((x1 - x0) * SPP, e.dy, &ra);
+  e.r   = ra;
 
-    for (int i = 0; i<HEIGHT; i++)
-      for (int j=0; j<MAX_SPANS_PER_LINE; j++)
-        scanlines[i][j] = EMPTY_SCAN_SLOT;
+  if (et->count == MAX_EDGES)
+    {
+      /* full: the edges starting lowest are left to a later band */
+      if (e.ytop >= et->edges[MAX_EDGES-1].ytop)
+        et->stop = e.ytop;
+      else
+        et->stop = et->edges[MAX_EDGES-1].ytop;
+      while (et->count > 0 && et->edges[et->count-1].ytop >= et->stop)
+        et->count--;
+      if (e.ytop >= et->stop)
+        return;
+    }
 
-    first_x = prev_x = path->nodes[0].x / SPP;
-    first_y = prev_y = path->nodes[0].y / SPP;
+  /* insert sorted by ytop */
+  t = et->count++;
+  while (t > 0 && et->edges[t-1].ytop > e.ytop)
+    {
+      et->edges[t] = et->edges[t-1];
+      t--;
+    }
+  et->edges[t] = e;
+}
 
-    /* saturate scanline intersection list */
-    iter = &path->nodes[1];
-    for (int i=1; i<path->count; i++, iter++)
-      {
-        switch (iter->type)
-          {
-            int dest_x;
-            int dest_y;
-            case 'm':
-              {
-                first_x = prev_x = iter->x / SPP;
-                first_y = prev_y = iter->y / SPP;
-                break;
-              }
-            case 'l':
-              {
-                dest_x = iter->x / SPP;
-                dest_y = iter->y / SPP;
-fill_close:  /* label used for goto to close last segment */
+static void o_fill_edges (EdgeTable *et)
+{
+  Node *iter = &path->nodes[0];
+  int   prev_x = 0, prev_y = 0;
+  int   first_x = 0, first_y = 0;
 
-                fill_line (prev_x, prev_y, dest_x, dest_y, scanlines, &lastdir, &lastline);
-
-                prev_x = dest_x;
-                prev_y = dest_y;
-                /* if we're on the last knot, fake the first vertex being a next one */
-                if (i+1 == path->count)
-                  {
-                    dest_x = first_x;
-                    dest_y = first_y;
-                    i++; /* to make the loop finally end */
-                    goto fill_close;
-                  }
-                break;
-              }
+  for (int i=0; i<path->count; i++, iter++)
+    {
+      switch (iter->type)
+        {
+          case 'm':
+            o_add_edge (et, prev_x, prev_y, first_x, first_y); /* close */
+            first_x = prev_x = iter->x;
+            first_y = prev_y = iter->y;
+            break;
+          case 'l':
+            o_add_edge (et, prev_x, prev_y, iter->x, iter->y);
+            prev_x = iter->x;
+            prev_y = iter->y;
+            break;
           case 'C':
             { /* create piecevize linear approximation of bezier curve */
-               int   i;
                Node *pts[4];
 
-               for (i=0;i<4;i++)
-                   pts[i]=&iter[i-3];
-               for (i=0; i< FIXED_ONE; i+= FIXED_ONE/ BEZIER_SEGMENTS)
+               for (int j=0;j<4;j++)
+                   pts[j]=&iter[j-3];
+               for (int j=0; j< FIXED_ONE; j+= FIXED_ONE/ BEZIER_SEGMENTS)
                  {
                     Node iter2;
-                    bezier (pts, &iter2, i);
-                    fill_line (prev_x, prev_y, iter2.x/SPP, iter2.y/SPP, scanlines, &lastdir, &lastline);
-                    prev_x = iter2.x / SPP;
-                    prev_y = iter2.y / SPP;
-                 }
-               if (i+1 == path->count)
-                 {
-                   dest_x = first_x;
-                   dest_y = first_y;
-                   i++; /* to make the loop finally end */
-                   goto fill_close;
+                    bezier (pts, &iter2, j);
+                    o_add_edge (et, prev_x, prev_y, iter2.x, iter2.y);
+                    prev_x = iter2.x;
+                    prev_y = iter2.y;
                  }
+               o_add_edge (et, prev_x, prev_y, iter->x, iter->y);
+               prev_x = iter->x;
+               prev_y = iter->y;
                break;
             }
-          }
-      }
+        }
+    }
+  o_add_edge (et, prev_x, prev_y, first_x, first_y);
+}
 
-    /* Fill the spans */
-    for (int i=0; i < HEIGHT; i++)
-      {
-        for (int j=0; j<MAX_SPANS_PER_LINE-2; j+=2)
-          {
-            if (scanlines[i][j] > EMPTY_SCAN_SLOT)
-              {
-                o_render_span (scanlines[i][j], i, scanlines[i][j+1],
+void o_fill (void)
+{
+  Edge          edges[MAX_EDGES];
+  unsigned char active[MAX_EDGES];
+  EdgeTable     et;
+
+  if (path->count < 1)
+    return;
+
+  et.edges = edges;
+  et.band  = 0;
+  while (et.band < HEIGHT)
+    {
+      int next = 0;   /* next edge to become active */
+      int nactive = 0;
+
+      et.count = 0;
+      et.stop  = HEIGHT;
+      o_fill_edges (&et);
+      if (et.stop <= et.band) /* too many edges on one row */
+        et.stop = et.band + 1;
+
+      for (int y = et.band; y < et.stop; y++)
+        {
+          int j = 0;
+
+          /* retire finished edges, step the others */
+          for (int i = 0; i < nactive; i++)
+            {
+              Edge *e = &edges[active[i]];
+              if (e->ybot <= y)
+                continue;
+              if (e->ytop < y)
+                {
+                  e->x   += e->q;
+                  e->err += e->r;
+                  if (e->err >= e->dy)
+                    {
+                      e->x++;
+                      e->err -= e->dy;
+                    }
+                }
+              active[j++] = active[i];
+            }
+          nactive = j;
+
+          while (next < et.count && edges[next].ytop <= y)
+            active[nactive++] = next++;
+
+          /* keep sorted by x, mostly sorted already */
+          for (int i = 1; i < nactive; i++)
+            {
+              unsigned char a = active[i];
+              for (j = i; j > 0 && edges[active[j-1]].x > edges[a].x; j--)
+                active[j] = active[j-1];
+              active[j] = a;
+            }
+
+          /* pixel x is inside if its centre is */
+          for (int i = 0; i+1 < nactive; i += 2)
+            o_render_span (
+              o_ceil_px (edges[active[i]].x   + (edges[active[i]].err > 0)), y,
+              o_ceil_px (edges[active[i+1]].x + (edges[active[i+1]].err > 0)),
 #ifdef O_ENABLE_USER_SHADER
-                      context()->shader,
+              context()->shader,
 #endif
-                      context()->shader_data);
-              }
-          }
-      }
-  }
+              context()->shader_data);
+        }
+      et.band = et.stop;
+    }
 }
 
 #endif
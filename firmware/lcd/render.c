@@ -8,6 +8,9 @@
 #include "fonts/smallfonts.h"
 
 #include "filesystem/ff.h"
+#include "filesystem/diskio.h"
+#include "filesystem/extent.h"
+#include "filesystem/at45db041d.h"
 #include "render.h"
 
 /* Global Variables */
@@ -16,13 +19,211 @@ const struct FONT_DEF * font = NULL;
 struct EXTFONT efont;
 
 static FIL file; /* current font file */
+static EXTENT fext; /* where it is on the flash, if contiguous */
+static uint8_t fraw; /* read it from there, not through FatFs */
+
+/* The font file is read through a block buffer. DoChar() loads each
+ * glyph with font_glyph(), which starts the block at the glyph, so a
+ * glyph up to FONT_BLOCK bytes costs one flash read. The largest
+ * glyphs of the shipped fonts are 120 (orbit32), 117 (ubuntu36) and
+ * 81 bytes (ubuntu29, soviet38). Other accesses fill whole blocks.
+ * Seeks only move fpos, the byte-wise access of the decoder stays
+ * inside the buffer. */
+#define FONT_BLOCK 128
+
+static uint8_t  fblock[FONT_BLOCK];
+static uint32_t fblock_pos;     /* file offset of fblock */
+static uint16_t fblock_len=0;   /* 0: empty */
+static uint32_t fpos;           /* read position */
+
+/* read len bytes at fpos, returns the number read */
+static int font_load(uint8_t *dst, int len){
+    UINT readbytes;
+
+    if(fraw){
+        readbytes=fpos<fext.size?fext.size-fpos:0;
+        if(readbytes>len)
+            readbytes=len;
+        if(readbytes &&
+                dataflash_random_read(dst, fext.offset+fpos, readbytes))
+            return 0;
+    }else{
+        if(f_lseek(&file,fpos) != FR_OK)
+            return 0;
+        if(f_read(&file, dst, len, &readbytes) != FR_OK)
+            return 0;
+    };
+    return readbytes;
+}
+
+static int font_fill(int len){
+    if(len>FONT_BLOCK)
+        len=FONT_BLOCK;
+    fblock_pos=fpos;
+    fblock_len=font_load(fblock,len);
+    return fblock_len>0;
+}
+
+static int font_cached(int len){
+    return fblock_len && fpos>=fblock_pos &&
+        fpos+len<=fblock_pos+fblock_len;
+}
+
+/* make the len bytes of the glyph at fpos one read */
+static void font_glyph(int len){
+    if(len>0 && !font_cached(len))
+        font_fill(len);
+}
+
+/* returns the number of bytes read */
+static int font_read(void *buf, int len){
+    uint8_t *p=buf;
+    int n=0, chunk;
+
+    while(n<len){
+        if(!font_cached(1)){
+            if(len-n>=FONT_BLOCK){ /* large reads bypass the block */
+                chunk=font_load(p+n,len-n);
+                fpos+=chunk;
+                n+=chunk;
+                break;
+            };
+            if(!font_fill(FONT_BLOCK))
+                break;
+        };
+        chunk=fblock_pos+fblock_len-fpos;
+        if(chunk>len-n)
+            chunk=len-n;
+        memcpy(p+n,fblock+(fpos-fblock_pos),chunk);
+        fpos+=chunk;
+        n+=chunk;
+    };
+    return n;
+}
+
+/* Glyph index of the current font, so DoChar() does not have to sum
+ * up the widths of all preceding glyphs: idx_off[i] is the offset of
+ * glyph i*IDX_STEP (in the units of the width table), at most
+ * IDX_STEP-1 widths are added to that. The width table of external
+ * fonts and their extras are kept here as well. Fonts that do not fit
+ * fall back to the linear search. */
+#define IDX_GLYPHS 128
+#define IDX_STEP   8
+#define IDX_EXTRAS 16
+
+static const struct FONT_DEF * idx_font = NULL; /* index belongs to */
+static uint8_t  idx_ok;       /* offsets are valid */
+static uint8_t  idx_ext;      /* widths are in idx_width */
+static uint16_t idx_off[IDX_GLYPHS/IDX_STEP];
+static uint8_t  idx_width[IDX_GLYPHS];
+static uint16_t idx_extra[IDX_EXTRAS];
+static int      idx_nextras;  /* -1: extras not in RAM */
+
+static int _getIndex(int c);
 
 /* Exported Functions */
 
+static void indexIntFont(void){
+    int glyphs;
+    uint16_t sum=0;
+
+    idx_font=font;
+    idx_ok=0;
+    idx_ext=0;
+
+    idx_nextras=0;
+    if(font->charExtra != NULL)
+        while(font->charExtra[idx_nextras] != 0xffff)
+            idx_nextras++;
+
+    if(font->u8Width>1) // fixed width, nothing to index
+        return;
+
+    glyphs=font->u8LastChar-font->u8FirstChar+1+idx_nextras;
+    if(glyphs>IDX_GLYPHS)
+        return;
+    for(int i=0;i<glyphs;i++){
+        if(i%IDX_STEP==0)
+            idx_off[i/IDX_STEP]=sum;
+        sum+=font->charInfo[i].widthBits;
+    };
+    idx_ok=1;
+}
+
+/* Called right after START_FONT, the file points to the extras */
+static void indexExtFont(int extras){
+    int glyphs=extras+font->u8LastChar-font->u8FirstChar;
+    uint32_t sum=0;
+
+    idx_font=font;
+    idx_ok=0;
+    idx_ext=1;
+    idx_nextras=-1;
+
+    if(extras<=IDX_EXTRAS){
+        if(font_read(idx_extra, extras*sizeof(uint16_t))
+                != extras*sizeof(uint16_t))
+            return;
+        idx_nextras=0;
+        while(idx_nextras<extras && idx_extra[idx_nextras] != 0xffff)
+            idx_nextras++;
+    };
+
+    if(glyphs>IDX_GLYPHS)
+        return;
+    /* the whole width table in one go */
+    _getFontData(SEEK_WIDTH,0);
+    if(font_read(idx_width, glyphs) != glyphs)
+        return;
+    for(int i=0;i<glyphs;i++){
+        if(i%IDX_STEP==0)
+            idx_off[i/IDX_STEP]=sum;
+        sum+=idx_width[i];
+    };
+    if(sum>0xffff)
+        return;
+    idx_ok=1;
+}
+
+static int idxWidth(int c){
+    return idx_ext ? idx_width[c] : font->charInfo[c].widthBits;
+}
+
+/* Offset of glyph c into the font table, and its width */
+static int glyphOffset(int c, int *width){
+    int toff=0;
+
+    if(idx_ok){
+        toff=idx_off[c/IDX_STEP];
+        for(int y=c-c%IDX_STEP;y<c;y++)
+            toff+=idxWidth(y);
+        *width=idxWidth(c);
+        return toff;
+    };
+    if(efont.type == FONT_EXTERNAL){
+        _getFontData(SEEK_WIDTH,0);
+        for(int y=0;y<c;y++)
+            toff+=_getFontData(GET_WIDTH,0);
+        *width=_getFontData(GET_WIDTH,0);
+    }else{
+        for(int y=0;y<c;y++)
+            toff+=font->charInfo[y].widthBits;
+        *width=font->charInfo[c].widthBits;
+    };
+    return toff;
+}
+
+/* Forget the external font, reopen and reindex the file on next use */
+static void font_reopen(void){
+    if(efont.type == FONT_EXTERNAL)
+        font=NULL;
+}
+
 void setIntFont(const struct FONT_DEF * newfont){
     memcpy(&efont.def,newfont,sizeof(struct FONT_DEF));
     efont.type=FONT_INTERNAL;
     font=&efont.def;
+    indexIntFont();
 }
 
 void setExtFont(const char *fname){
@@ -33,6 +234,8 @@ void setExtFont(const char *fname){
 
     efont.type=FONT_EXTERNAL;
     font=NULL;
+    idx_font=NULL; // rebuilt when the file is opened
+    diskcacheDropHook(font_reopen); // USB may replace the file
 }
 
 int getFontHeight(void){
@@ -43,15 +246,12 @@ int getFontHeight(void){
 
 static uint8_t read_byte (void)
 {
-  UINT    readbytes;
-  uint8_t byte;
-  f_read(&file, &byte, sizeof(uint8_t), &readbytes);
+  uint8_t byte=0;
+  font_read(&byte, sizeof(uint8_t));
   return byte;
 }
 
 int _getFontData(int type, int offset){
-    UINT readbytes;
-    UINT res;
     static uint16_t extras;
     static uint16_t character;
 //    static const void * ptr;
@@ -59,24 +259,26 @@ int _getFontData(int type, int offset){
     if(efont.type == FONT_EXTERNAL){
 
     if (type == START_FONT){
+        fpos=0;
+        fblock_len=0; // new file
         efont.def.u8Width = read_byte ();
         efont.def.u8Height = read_byte ();
         efont.def.u8FirstChar = read_byte ();
         efont.def.u8LastChar = read_byte ();
-        res = f_read(&file, &extras, sizeof(uint16_t), &readbytes);
-        return 0;
+        font_read(&extras, sizeof(uint16_t));
+        return extras;
     };
     if (type == SEEK_EXTRAS){
-        f_lseek(&file,6);
+        fpos=6;
         return 0;
     };
     if(type == GET_EXTRAS){
-        uint16_t word;
-        res = f_read(&file, &word, sizeof(uint16_t), &readbytes);
+        uint16_t word=0;
+        font_read(&word, sizeof(uint16_t));
         return word;
     };
     if (type == SEEK_WIDTH){
-        f_lseek(&file,6+(extras*sizeof(uint16_t)));
+        fpos=6+(extras*sizeof(uint16_t));
         return 0;
     };
     if(type == GET_WIDTH || type == GET_DATA){
@@ -84,21 +286,19 @@ int _getFontData(int type, int offset){
     };
     if(type == SEEK_DATA){
         character=offset;
-        f_lseek(&file,6+
+        fpos=6+
                 (extras*sizeof(uint16_t))+
                 ((extras+font->u8LastChar-font->u8FirstChar)*sizeof(uint8_t))+
-                (offset*sizeof(uint8_t))
-                );
+                (offset*sizeof(uint8_t));
         return 0;
     };
     if(type == PEEK_DATA){
         uint8_t width;
         width = read_byte ();
-        f_lseek(&file,6+
+        fpos=6+
                 (extras*sizeof(uint16_t))+
                 ((extras+font->u8LastChar-font->u8FirstChar)*sizeof(uint8_t))+
-                (character*sizeof(uint8_t))
-                );
+                (character*sizeof(uint8_t));
         return width;
     };
 #ifdef NOTYET
@@ -153,7 +353,25 @@ static int _getIndex(int c){
         c=ERRCHR;
 
     if(c>font->u8LastChar && (efont.type==FONT_EXTERNAL || font->charExtra != NULL)){
-        if(efont.type==FONT_EXTERNAL){
+        if(idx_nextras>=0){
+            /* extras are sorted: binary search */
+            const uint16_t *extra=idx_extra;
+            int lo=0, hi=idx_nextras;
+
+            if(efont.type!=FONT_EXTERNAL)
+                extra=font->charExtra;
+            while(lo<hi){
+                int mid=(lo+hi)/2;
+                if(extra[mid]<c)
+                    lo=mid+1;
+                else
+                    hi=mid;
+            };
+            if(lo==idx_nextras || extra[lo] != c)
+                c=ERRCHR;
+            else
+                c=font->u8LastChar+lo+1;
+        }else if(efont.type==FONT_EXTERNAL){
             _getFontData(SEEK_EXTRAS,0);
             int cc=0;
             int cache;
@@ -187,18 +405,23 @@ int DoChar(int sx, int sy, int c){
             font=&efont.def;
         }else if (efont.type==FONT_EXTERNAL){
             UINT res;
-            res=f_open(&file, efont.name, FA_OPEN_EXISTING|FA_READ);
+            fraw=(fileExtent(efont.name,&fext)==0);
+            res=fraw?FR_OK:f_open(&file, efont.name, FA_OPEN_EXISTING|FA_READ);
             if(res){
                 efont.type=0;
                 font=&Font_7x8;
             }else{
-                _getFontData(START_FONT,0);
+                int extras=_getFontData(START_FONT,0);
                 font=&efont.def;
+                indexExtFont(extras);
             };
         }else{
             font=&Font_7x8;
         };
     };
+    if(font!=idx_font){ // somebody set font directly
+        indexIntFont();
+    };
 
 	/* how many bytes is it high? */
 	char height=(font->u8Height-1)/8+1;
@@ -214,39 +437,25 @@ int DoChar(int sx, int sy, int c){
         int toff=0;
 
         if(font->u8Width==0){
+            toff=glyphOffset(c,&width);
             if(efont.type == FONT_EXTERNAL){
-                _getFontData(SEEK_WIDTH,0);
-                for(int y=0;y<c;y++)
-                    toff+=_getFontData(GET_WIDTH,0);
-                width=_getFontData(GET_WIDTH,0);
-
                 _getFontData(SEEK_DATA,toff);
-                UINT res;
-                UINT readbytes;
+                font_glyph(width*height);
                 UINT size = width * height;
                 if(size > MAXCHR) size = MAXCHR;
-                res = f_read(&file, charBuf, size, &readbytes);
-                if(res != FR_OK || readbytes<width*height)
+                if(font_read(charBuf, size)<width*height)
                     return sx;
                 data=charBuf;
             }else{
-                for(int y=0;y<c;y++)
-                    toff+=font->charInfo[y].widthBits;
-                width=font->charInfo[c].widthBits;
-
                 toff*=height;
                 data=&font->au8FontTable[toff];
             };
             postblank=1;
         }else if(font->u8Width==1){ // NEW CODE
+            toff=glyphOffset(c,&width);
             if(efont.type == FONT_EXTERNAL){
-                _getFontData(SEEK_WIDTH,0);
-                for(int y=0;y<c;y++)
-                    toff+=_getFontData(GET_WIDTH,0);
-                width=_getFontData(GET_WIDTH,0);
                 _getFontData(SEEK_DATA,toff);
-                UINT res;
-                UINT readbytes;
+                font_glyph(width); /* packed: width is in bytes */
                 uint8_t testbyte;
                 testbyte = read_byte ();
                 if(testbyte>>4 ==15){
@@ -256,8 +465,7 @@ int DoChar(int sx, int sy, int c){
                     width/=height;
                     UINT size = width * height;
                     if(size > MAXCHR) size = MAXCHR;
-                    res = f_read(&file, charBuf, size, &readbytes);
-                    if(res != FR_OK || readbytes<width*height)
+                    if(font_read(charBuf, size)<width*height)
                         return sx;
                     data=charBuf;
                 }else{
@@ -265,10 +473,6 @@ int DoChar(int sx, int sy, int c){
                     data=pk_decode(NULL,&width); // Hackety-hack
                 };
             }else{
-                // Find offset and length for our character
-                for(int y=0;y<c;y++)
-                    toff+=font->charInfo[y].widthBits;
-                width=font->charInfo[c].widthBits;
                 if(font->au8FontTable[toff]>>4 == 15){ // It's a raw character!
                     preblank = font->au8FontTable[toff+1];
                     postblank= font->au8FontTable[toff+2];
@@ -380,6 +584,9 @@ int DoChar(int sx, int sy, int c){
 			lcdBuffer[xy_(sx+x+m,yidx+y)]&=~mask;
 		};
 	};
+    /* line yidx starts at screen row yidx*8-(8-RESY%8) */
+    lcdMarkDirty(sx-preblank, yidx*8-(8-RESY%8),
+            sx+width+postblank-1, (yidx+height)*8+7-(8-RESY%8));
 	return sx+(width+postblank);
 }
 
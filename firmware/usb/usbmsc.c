@@ -24,6 +24,7 @@ void usbMSCRead(uint32_t offset, uint8_t dst[], uint32_t length) {
 
 void usbMSCInit(void) {
   dataflash_initialize();
+  diskcacheDrop();                                    // the host writes behind FatFs
 
   // Setup USB clock
   SCB_PDRUNCFG &= ~(SCB_PDSLEEPCFG_USBPAD_PD);        // Power-up USB PHY
@@ -96,6 +97,7 @@ void USB_IRQHandler() {
 
 void usbMSCOff(void) {
   (*rom)->pUSBD->connect(false);     /* USB Disconnect */
+  diskcacheDrop();
   usbMSCenabled&=~USB_MSC_ENABLEFLAG;
 }
 
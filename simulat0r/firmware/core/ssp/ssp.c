@@ -1,5 +1,6 @@
 #define sspInit _hideaway_sspInit
 #define sspSend _hideaway_sspSend
+#define sspSend16 _hideaway_sspSend16
 #define sspReceive _hideaway_sspReceive
 #define sspSendReceive _hideaway_sspSendReceive
 
@@ -7,6 +8,7 @@
 
 #undef sspInit
 #undef sspSend
+#undef sspSend16
 #undef sspReceive
 #undef sspSendReceive
 
@@ -16,6 +18,9 @@ void sspInit (uint8_t portNum, sspClockPolarity_t polarity, sspClockPhase_t phas
 void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length) {
 }
 
+void sspSend16 (uint8_t portNum, const uint16_t *buf, uint32_t length) {
+}
+
 void sspReceive (uint8_t portNum, uint8_t *buf, uint32_t length) {
 }
 
@@ -2,9 +2,11 @@
 #define lcdRefresh _hideaway_lcdRefresh
 #endif
 #define lcdDisplay _hideaway_lcdDisplay
+#define lcdPresent _hideaway_lcdPresent
 #define lcdInit _hideaway_lcdInit
 #include "../../../firmware/lcd/display.c"
 #undef lcdDisplay
+#undef lcdPresent
 #undef lcdInit
 #ifdef __APPLE__
 #undef lcdRefresh
@@ -22,5 +24,9 @@ void lcdRefresh() {
 }
 #endif
 
+void lcdPresent() {
+  simlcdDisplayUpdate();
+}
+
 void lcdInit() {
 }
@@ -0,0 +1,78 @@
+/* Check the CRC_VARIANTs of firmware/basic/crc.c against each other
+ * and time them. Exits nonzero on any mismatch. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define DECL(n) \
+    uint16_t crc16_##n(uint8_t * buf, int len); \
+    uint16_t crc16_update_##n(uint16_t crc, const uint8_t * buf, int len);
+DECL(0)
+DECL(1)
+DECL(2)
+
+struct {
+    const char *name;
+    uint16_t (*crc)(uint8_t *, int);
+    uint16_t (*update)(uint16_t, const uint8_t *, int);
+} variants[] = {
+    { "loop",   crc16_0, crc16_update_0 },
+    { "nibble", crc16_1, crc16_update_1 },
+    { "table",  crc16_2, crc16_update_2 },
+};
+#define NVARIANTS (sizeof(variants)/sizeof(*variants))
+
+#define BUFSIZE 4096
+#define ROUNDS  20000
+
+int main(void){
+    static uint8_t buf[BUFSIZE];
+    uint8_t check[] = "123456789";
+    int fail = 0;
+
+    srand(time(NULL));
+
+    for(int v=0; v<NVARIANTS; v++){
+        uint16_t c = variants[v].crc(check, 9);
+        if( c != 0x29b1 ){
+            printf("%s: check value %04x, expected 29b1\n",
+                    variants[v].name, c);
+            fail++;
+        }
+    }
+
+    for(int r=0; r<1000; r++){
+        int len = rand()%BUFSIZE;
+        for(int i=0; i<len; i++)
+            buf[i] = rand();
+        uint16_t ref = variants[0].crc(buf, len);
+        for(int v=0; v<NVARIANTS; v++){
+            uint16_t c = variants[v].crc(buf, len);
+            int split = len ? rand()%len : 0;
+            uint16_t inc = variants[v].update(0xffff, buf, split);
+            inc = variants[v].update(inc, buf+split, len-split);
+            if( c != ref || inc != ref ){
+                printf("%s: len %d: %04x/%04x, expected %04x\n",
+                        variants[v].name, len, c, inc, ref);
+                fail++;
+            }
+        }
+    }
+
+    for(int i=0; i<BUFSIZE; i++)
+        buf[i] = rand();
+    for(int v=0; v<NVARIANTS; v++){
+        volatile uint16_t sink = 0;
+        clock_t start = clock();
+        for(int r=0; r<ROUNDS; r++)
+            sink ^= variants[v].crc(buf, BUFSIZE);
+        double s = (double)(clock()-start)/CLOCKS_PER_SEC;
+        printf("%-8s %8.1f MB/s\n", variants[v].name,
+                (double)BUFSIZE*ROUNDS/s/1e6);
+    }
+
+    printf("%s\n", fail ? "FAILED" : "OK");
+    return fail ? 1 : 0;
+}
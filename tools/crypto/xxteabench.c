@@ -0,0 +1,101 @@
+/* Check the unrolled n=4/n=8 kernels of firmware/basic/xxtea.c
+ * against the generic code and fixed test vectors, and time them.
+ * Exits nonzero on any mismatch. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+void xxtea_encode_words(uint32_t *v, int n, uint32_t const k[4]);
+void xxtea_decode_words(uint32_t *v, int n, uint32_t const k[4]);
+void generic_encode_words(uint32_t *v, int n, uint32_t const k[4]);
+void generic_decode_words(uint32_t *v, int n, uint32_t const k[4]);
+
+static const uint32_t vkey[4] =
+    { 0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210 };
+
+/* plaintext is 0x00, 0x01, 0x02, ... */
+static const uint8_t vec4[16] = {
+    0x14, 0x85, 0x61, 0xfe, 0xa3, 0x1f, 0x01, 0x94,
+    0x0a, 0x34, 0xc4, 0x32, 0x36, 0xb1, 0x95, 0x3f,
+};
+static const uint8_t vec8[32] = {
+    0x42, 0x45, 0x56, 0x20, 0xed, 0x09, 0xd1, 0x32,
+    0x11, 0xb2, 0x44, 0xdb, 0x06, 0x57, 0xd3, 0x5a,
+    0xaa, 0x83, 0x1d, 0x91, 0x41, 0x6d, 0xab, 0x82,
+    0xb9, 0xe4, 0x7c, 0x5f, 0x6a, 0x3f, 0xfc, 0x48,
+};
+
+static int vector(int n, const uint8_t *expect){
+    uint32_t w[8];
+    uint8_t *b = (uint8_t *)w;
+    int fail = 0;
+
+    for(int i=0; i<n*4; i++)
+        b[i] = i;
+    xxtea_encode_words(w, n, vkey);
+    if( memcmp(b, expect, n*4) ){
+        printf("n=%d: encode does not match test vector\n", n);
+        fail++;
+    }
+    xxtea_decode_words(w, n, vkey);
+    for(int i=0; i<n*4; i++)
+        if( b[i] != i ){
+            printf("n=%d: decode does not match test vector\n", n);
+            fail++;
+            break;
+        }
+    return fail;
+}
+
+#define ROUNDS 200000
+
+static double bench(void (*f)(uint32_t *, int, uint32_t const *), int n){
+    uint32_t w[8] = { 0 };
+    clock_t start = clock();
+
+    for(int r=0; r<ROUNDS; r++)
+        f(w, n, vkey);
+    return (double)(clock()-start)/CLOCKS_PER_SEC*1e9/ROUNDS;
+}
+
+int main(void){
+    uint32_t k[4], a[16], b[16];
+    int fail = 0;
+
+    srand(time(NULL));
+
+    fail += vector(4, vec4);
+    fail += vector(8, vec8);
+
+    for(int r=0; r<10000; r++){
+        int n = 2+rand()%15;
+        for(int i=0; i<4; i++)
+            k[i] = rand();
+        for(int i=0; i<n; i++)
+            a[i] = b[i] = rand();
+        xxtea_encode_words(a, n, k);
+        generic_encode_words(b, n, k);
+        if( memcmp(a, b, n*4) ){
+            printf("n=%d: encode differs from generic code\n", n);
+            fail++;
+        }
+        xxtea_decode_words(a, n, k);
+        generic_decode_words(b, n, k);
+        if( memcmp(a, b, n*4) ){
+            printf("n=%d: decode differs from generic code\n", n);
+            fail++;
+        }
+    }
+
+    for(int n=4; n<=8; n+=4){
+        printf("n=%d encode: %7.1f ns generic, %7.1f ns unrolled\n", n,
+                bench(generic_encode_words, n), bench(xxtea_encode_words, n));
+        printf("n=%d decode: %7.1f ns generic, %7.1f ns unrolled\n", n,
+                bench(generic_decode_words, n), bench(xxtea_decode_words, n));
+    }
+
+    printf("%s\n", fail ? "FAILED" : "OK");
+    return fail ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+/* Check firmware/filesystem/at45db041d.c against the old driver
+ * (DF_CONTREAD=0, DF_PINGPONG=0) on a model of the AT45DB041D, in both
+ * page size modes: reads, sync and async writes of random ranges and
+ * the commands the driver sends while the chip is busy. Writes are
+ * timed with the datasheet's typical program times, the result is
+ * printed per variant. Exits nonzero on any error. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "filesystem/diskio.h"
+#include "basic/basic.h"
+
+#define DECL(n) \
+    DSTATUS dataflash_initialize_##n(void); \
+    DRESULT dataflash_random_read_##n(BYTE *buff, DWORD offset, DWORD length); \
+    DRESULT dataflash_write_##n(const BYTE *buff, DWORD sector, BYTE count); \
+    DRESULT dataflash_random_write_##n(const BYTE *buff, DWORD offset, DWORD length); \
+    DRESULT dataflash_ioctl_##n(BYTE ctrl, void *buff);
+DECL(0)
+DECL(1)
+
+#define PAGES    2048
+#define PAGESIZE 264
+#define FLASH    (PAGES*256)
+
+/* timing in us: 4 MHz SPI, typical page erase and program, compare
+ * and page to buffer transfer (the datasheet gives maxima only) */
+#define T_FRAME  2
+#define T_PROG   14000
+#define T_COMP   200
+#define T_XFR    200
+
+/* chip model, one per variant */
+struct chip {
+    uint8_t mem[PAGES*PAGESIZE];
+    uint8_t buf[2][PAGESIZE];
+    long now;           /* clock, advanced by SPI frames */
+    long busy_until;
+    int busy_buffer;    /* buffer of the running operation */
+    int comp;           /* last compare differed */
+};
+static struct chip chips[2];
+static struct chip *chip;
+static int binary;          /* 256 byte pages */
+static int cs;              /* chip selected */
+static uint8_t cmd[8];
+static int ncmd;
+static uint32_t pos;        /* next byte to be read or written */
+static long commands, frames, errors;
+
+static int pagesize(void){
+    return binary ? 256 : PAGESIZE;
+}
+
+static int ready(void){
+    return chip->now >= chip->busy_until;
+}
+
+static void error(const char *what){
+    if( errors++ < 10 )
+        printf("%s: %s (opcode %02X)\n", binary ? "binary" : "264 byte",
+                what, cmd[0]);
+}
+
+static int hdr_len(void){
+    switch( cmd[0] ){
+        case 0xD7: case 0xB9: case 0xAB:
+            return 1;
+        case 0xD2:
+            return 8;
+    }
+    return 4;
+}
+
+static uint32_t cmd_addr(void){
+    return cmd[1]<<16 | cmd[2]<<8 | cmd[3];
+}
+
+static uint8_t *cmd_page(void){
+    return chip->mem + (cmd_addr() >> (binary ? 8 : 9)) * pagesize();
+}
+
+/* header complete */
+static void cmd_start(void){
+    uint32_t addr = cmd_addr(), shift = binary ? 8 : 9;
+
+    switch( cmd[0] ){
+        case 0xD2: case 0x03:
+            if( !ready() )
+                error("read while busy");
+            pos = (addr >> shift) * pagesize() + (addr & ((1<<shift)-1));
+            break;
+        case 0x84: case 0x87:
+            if( !ready() && chip->busy_buffer == (cmd[0] == 0x87) )
+                error("buffer written while in use");
+            pos = addr % pagesize();
+            break;
+    }
+}
+
+/* CS raised: run the page operations */
+static void cmd_end(void){
+    int b;
+
+    switch( cmd[0] ){
+        case 0x53: case 0x55: b = cmd[0] == 0x55; break;
+        case 0x60: case 0x61: b = cmd[0] == 0x61; break;
+        case 0x83: case 0x86: b = cmd[0] == 0x86; break;
+        default: return;
+    }
+    if( ncmd < 4 )
+        return;
+    if( !ready() )
+        error("page command while busy");
+    chip->busy_buffer = b;
+    switch( cmd[0] ){
+        case 0x53: case 0x55:
+            memcpy(chip->buf[b], cmd_page(), pagesize());
+            chip->busy_until = chip->now + T_XFR;
+            break;
+        case 0x60: case 0x61:
+            chip->comp = memcmp(chip->buf[b], cmd_page(), pagesize()) != 0;
+            chip->busy_until = chip->now + T_COMP;
+            break;
+        case 0x83: case 0x86:
+            memcpy(cmd_page(), chip->buf[b], pagesize());
+            chip->busy_until = chip->now + T_PROG;
+            break;
+    }
+}
+
+static uint8_t chip_byte(void){
+    uint8_t b;
+
+    switch( cmd[0] ){
+        case 0xD7:  /* status */
+            return (ready() ? 0x80 : 0) | chip->comp << 6 | 0x1C | binary;
+        case 0xD2:  /* page read, wraps within the page */
+            b = chip->mem[pos];
+            if( ++pos % pagesize() == 0 )
+                pos -= pagesize();
+            return b;
+        case 0x03:  /* continuous array read */
+            b = chip->mem[pos];
+            pos = (pos+1) % (PAGES*pagesize());
+            return b;
+    }
+    return 0xff;
+}
+
+void gpioSetDir (uint32_t port, uint32_t bit, int dir){
+}
+
+void gpioSetValue (uint32_t port, uint32_t bit, uint32_t value){
+    if( cs && value )
+        cmd_end();
+    cs = !value;
+    ncmd = 0;
+}
+
+void sspInit (uint8_t portNum, int polarity, int phase){
+}
+
+void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length){
+    frames += length;
+    chip->now += T_FRAME*length;
+    while( cs && length-- ){
+        if( ncmd == 0 && *buf != 0xD7 )
+            commands++;
+        if( ncmd < sizeof(cmd) )
+            cmd[ncmd] = *buf;
+        ncmd++;
+        if( ncmd == hdr_len() )
+            cmd_start();
+        else if( ncmd > hdr_len() && (cmd[0] == 0x84 || cmd[0] == 0x87) )
+            chip->buf[cmd[0] == 0x87][pos++ % pagesize()] = *buf;
+        buf++;
+    }
+}
+
+void sspReceive (uint8_t portNum, uint8_t *buf, uint32_t length){
+    frames += length;
+    chip->now += T_FRAME*length;
+    while( cs && length-- )
+        *buf++ = chip_byte();
+}
+
+/* work queue: the driver queues one job to finish async writes */
+static uint8_t (*queued[2])(uint8_t);
+static int cur;
+
+int push_queue_plus (uint8_t (*job)(uint8_t)){
+    queued[cur] = job;
+    return 0;
+}
+
+static void run_queue(int polls){
+    while( queued[cur] && polls-- )
+        if( queued[cur](1) == QS_END )
+            queued[cur] = NULL;
+}
+
+struct {
+    const char *name;
+    DSTATUS (*init)(void);
+    DRESULT (*read)(BYTE *, DWORD, DWORD);
+    DRESULT (*write)(const BYTE *, DWORD, BYTE);
+    DRESULT (*random_write)(const BYTE *, DWORD, DWORD);
+    DRESULT (*ioctl)(BYTE, void *);
+} variants[] = {
+    { "old", dataflash_initialize_0, dataflash_random_read_0,
+        dataflash_write_0, dataflash_random_write_0, dataflash_ioctl_0 },
+    { "new", dataflash_initialize_1, dataflash_random_read_1,
+        dataflash_write_1, dataflash_random_write_1, dataflash_ioctl_1 },
+};
+#define NVARIANTS (sizeof(variants)/sizeof(*variants))
+
+static void use(int v){
+    cur = v;
+    chip = &chips[v];
+}
+
+static uint8_t ref[FLASH];  /* what the flash should read */
+
+static void check(int v, const uint8_t *buf, DWORD ofs, DWORD len){
+    if( memcmp(buf, ref+ofs, len) ){
+        printf("%s pages: %s read %lu+%lu wrong\n",
+                binary ? "binary" : "264 byte", variants[v].name,
+                (unsigned long)ofs, (unsigned long)len);
+        errors++;
+    }
+}
+
+#define ROUNDS 2000
+#define MAXLEN 4096
+
+static void test_reads(void){
+    static uint8_t buf[NVARIANTS][MAXLEN];
+    long cmds[NVARIANTS] = { 0 }, frm[NVARIANTS] = { 0 };
+
+    for(int r=0; r<ROUNDS; r++){
+        DWORD len = 1+rand()%MAXLEN;
+        DWORD ofs = rand()%(FLASH-len+1);
+
+        if( r%4 == 0 ){     /* whole sectors, as FatFs reads */
+            len = 512*(1+rand()%(MAXLEN/512));
+            ofs = 512*(rand()%(PAGES/2-len/512+1));
+        }
+        for(int v=0; v<NVARIANTS; v++){
+            use(v);
+            commands = frames = 0;
+            memset(buf[v], v, len);
+            if( variants[v].read(buf[v], ofs, len) != RES_OK )
+                error("read failed");
+            check(v, buf[v], ofs, len);
+            cmds[v] += commands;
+            frm[v] += frames;
+        }
+    }
+    printf("%s pages, reads:\n", binary ? "binary" : "264 byte");
+    for(int v=0; v<NVARIANTS; v++)
+        printf("  %-4s %8ld commands %9ld frames\n",
+                variants[v].name, cmds[v], frm[v]);
+}
+
+/* random mix of sync (USB) and async (FatFs) writes, reads, syncs and
+ * time passing, with the work queue running in between */
+static void test_writes(void){
+    static uint8_t data[MAXLEN], buf[MAXLEN];
+
+    for(int r=0; r<ROUNDS; r++){
+        int op = rand()%8, idle = rand()%(2*T_PROG), polls = rand()%50;
+        DWORD len = 1+rand()%MAXLEN;
+        DWORD ofs = rand()%(FLASH-len+1);
+
+        if( op < 3 ){       /* sector writes, as FatFs */
+            len = 512*(1+rand()%(MAXLEN/512));
+            ofs = 512*(rand()%(PAGES/2-len/512+1));
+        }
+        for(DWORD i=0; i<len; i++)
+            data[i] = rand()%4 ? rand() : ref[ofs+i]; /* some unchanged */
+
+        for(int v=0; v<NVARIANTS; v++){
+            BYTE ctrl = 0;
+            DRESULT res = RES_OK;
+
+            use(v);
+            switch( op ){
+                case 0: case 1: case 2:
+                    res = variants[v].write(data, ofs/512, len/512);
+                    break;
+                case 3: case 4:
+                    res = variants[v].random_write(data, ofs, len);
+                    break;
+                case 5:
+                    res = variants[v].read(buf, ofs, len);
+                    check(v, buf, ofs, len);
+                    break;
+                case 6:
+                    res = variants[v].ioctl(CTRL_SYNC, &ctrl);
+                    break;
+                case 7:
+                    chip->now += idle;
+                    break;
+            }
+            if( res != RES_OK )
+                error("command failed");
+            run_queue(polls);
+        }
+        if( op < 5 )
+            memcpy(ref+ofs, data, len);
+    }
+
+    for(int v=0; v<NVARIANTS; v++){
+        use(v);
+        BYTE ctrl = 0;
+        variants[v].ioctl(CTRL_SYNC, &ctrl);
+        chip->now = chip->busy_until;
+        for(int p=0; p<PAGES; p++)
+            if( memcmp(chip->mem+p*pagesize(), ref+p*256, 256) ){
+                printf("%s pages: %s page %d wrong after writes\n",
+                        binary ? "binary" : "264 byte", variants[v].name, p);
+                errors++;
+                break;
+            }
+    }
+}
+
+/* sequential throughput: FatFs sectors and USB style 4K blocks of
+ * new data, until the last page is programmed */
+static void test_speed(void){
+    static uint8_t data[MAXLEN];
+    const DWORD total = 128*1024;
+    long start[NVARIANTS], cmds[NVARIANTS];
+    BYTE ctrl = 0;
+
+    printf("%s pages, writing %luK:\n", binary ? "binary" : "264 byte",
+            (unsigned long)total/1024);
+    for(int usb=0; usb<2; usb++){
+        for(int v=0; v<NVARIANTS; v++){
+            use(v);
+            chip->now = chip->busy_until;
+            start[v] = chip->now;
+            cmds[v] = 0;
+        }
+        for(DWORD ofs=0; ofs<total; ofs+=MAXLEN){
+            for(int i=0; i<MAXLEN; i++)
+                data[i] = ~ref[ofs+i];
+            for(int v=0; v<NVARIANTS; v++){
+                use(v);
+                commands = 0;
+                if( usb )
+                    variants[v].random_write(data, ofs, MAXLEN);
+                else
+                    variants[v].write(data, ofs/512, MAXLEN/512);
+                run_queue(1);
+                cmds[v] += commands;
+            }
+            memcpy(ref+ofs, data, MAXLEN);
+        }
+        for(int v=0; v<NVARIANTS; v++){
+            use(v);
+            variants[v].ioctl(CTRL_SYNC, &ctrl);
+            chip->now = chip->busy_until;
+            printf("  %-4s %-4s %6.1f KB/s %8ld commands\n",
+                    variants[v].name, usb ? "usb" : "fat",
+                    total*1e6/1024/(chip->now-start[v]), cmds[v]);
+        }
+    }
+}
+
+int main(void){
+    srand(time(NULL));
+
+    for(binary=0; binary<2; binary++){
+        for(int i=0; i<PAGES*pagesize(); i++)
+            chips[0].mem[i] = rand();
+        memcpy(chips[1].mem, chips[0].mem, sizeof(chips[0].mem));
+        for(int p=0; p<PAGES; p++)
+            memcpy(ref+p*256, chips[0].mem+p*pagesize(), 256);
+        for(int v=0; v<NVARIANTS; v++){
+            use(v);
+            chip->now = chip->busy_until = 0;
+            queued[v] = NULL;
+            variants[v].init();
+        }
+
+        test_reads();
+        test_writes();
+        test_speed();
+        test_reads();
+    }
+
+    if( errors )
+        printf("%ld errors\n", errors);
+    return errors != 0;
+}
@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include <time.h>
+
+#define RB_SPI_CS_DF            2,0
+#define gpioDirection_Output    1
+#define SSPBUS_DF               1
+#define YEAR0                   1900
+
+void gpioSetDir (uint32_t port, uint32_t bit, int dir);
+void gpioSetValue (uint32_t port, uint32_t bit, uint32_t value);
+static inline void sspbusAcquire (uint8_t dev) { (void)dev; }
+static inline void sspbusRelease (uint8_t dev) { (void)dev; }
+static inline time_t getSeconds (void) { return 0; }
+static inline struct tm *mygmtime (time_t t) { return gmtime(&t); }
+
+#define QS_END                  0x7f
+int push_queue_plus (uint8_t (*job)(uint8_t));
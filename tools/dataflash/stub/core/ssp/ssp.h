@@ -0,0 +1,8 @@
+#include <stdint.h>
+
+#define sspClockPolarity_Low      0
+#define sspClockPhase_RisingEdge  0
+
+void sspInit (uint8_t portNum, int polarity, int phase);
+void sspSend (uint8_t portNum, const uint8_t *buf, uint32_t length);
+void sspReceive (uint8_t portNum, uint8_t *buf, uint32_t length);
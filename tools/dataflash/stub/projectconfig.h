@@ -0,0 +1 @@
+/* host build of the dataflash driver, see dftest.c */
@@ -0,0 +1,122 @@
+#!/usr/bin/perl
+
+# lcdanim.pl - BSD Licence
+#
+# This script packs .lcd frames into a delta compressed animation
+# for lcdShowAnim(). See firmware/lcd/image.c for the format.
+
+use strict;
+use warnings;
+use Getopt::Long;
+
+$|=1;
+
+###
+### Runtime Options
+###
+
+my ($verbose);
+my $out="anim.lcd";
+my $keyint=0;
+my $ms=0;
+
+GetOptions (
+            "verbose"  => \$verbose, # flag
+            "output=s" => \$out,     # string
+            "key=i"    => \$keyint,  # keyframe every n frames
+            "ms=i"     => \$ms,      # frame time
+			"help"     => sub {
+			print <<HELP;
+Uasge: lcdanim.pl [-v] [-o out.lcd] [-k n] [-m ms] frames.lcd [...]
+
+Each input holds one or more raw frames, like the output of img2lcd.pl
+or an old style animation.
+
+Options:
+--verbose         Be verbose.
+--output <file>   Output file (default: anim.lcd).
+--key <n>         Insert a keyframe every n frames (default: only the first).
+--ms <ms>         Store a frame time (default: the caller's).
+HELP
+			exit(-1);}
+			);
+
+###
+### Code starts here.
+###
+
+my $FRAME=96*9;
+
+die "no input frames\n" unless @ARGV;
+
+my @frames;
+for my $in (@ARGV){
+	open(F,"<",$in)||die "open $in: $!";
+	binmode F;
+	local $/;
+	my $data=<F>;
+	close(F);
+	die "$in: not a multiple of $FRAME bytes\n" if length($data)%$FRAME;
+	push @frames, substr($data,$_*$FRAME,$FRAME) for 0..length($data)/$FRAME-1;
+};
+
+# codes for the XOR of two frames
+sub delta {
+	my @d=map {ord} split //, ($_[0] ^ $_[1]);
+	my $c="";
+	my $i=0;
+	pop @d while @d && !$d[-1];
+	while($i<@d){
+		my $n=0;
+		if(!$d[$i]){
+			$n++ while $i+$n<@d && !$d[$i+$n] && $n<128;
+			$c.=chr($n-1);
+		}else{
+			$n++ while $i+$n<@d && $d[$i+$n]==$d[$i] && $n<64;
+			if($n>2){
+				$c.=chr(0xc0+$n-1).chr($d[$i]);
+			}else{
+				# literal up to the next zero or repeat of three
+				$n=0;
+				while($i+$n<@d && $d[$i+$n] && $n<64){
+					last if $i+$n+2<@d
+						&& $d[$i+$n]==$d[$i+$n+1] && $d[$i+$n]==$d[$i+$n+2];
+					$n++;
+				};
+				$n=1 if !$n;
+				$c.=chr(0x80+$n-1).pack("C*",@d[$i..$i+$n-1]);
+			};
+		};
+		$i+=$n;
+	};
+	return $c;
+};
+
+my $empty="\0" x $FRAME;
+my @keys;
+my $body="";
+my $nkeys=$keyint ? int((@frames+$keyint-1)/$keyint) : 1;
+my $ofs=12+4*$nkeys;
+
+for my $f (0..$#frames){
+	my $key=$f==0 || ($keyint && $f%$keyint==0);
+	my $c=delta($frames[$f], $key ? $empty : $frames[$f-1]);
+	push @keys, $ofs+length($body) if $key;
+	$body.=pack("Cv",$key?1:0,length $c).$c;
+	if($verbose){
+		printf STDERR "frame %3d: %s%4d bytes\n",$f,$key?"key ":"",length $c;
+	};
+};
+
+open(F,">",$out)||die "open: $!";
+binmode F;
+print F "r0A".chr(1);
+print F pack("vvvv",scalar @frames,$ms,scalar @keys,0);
+print F pack("V*",@keys);
+print F $body;
+close(F);
+
+if($verbose){
+	printf STDERR "%d frames, %d -> %d bytes\n",
+		scalar @frames, @frames*$FRAME, 12+4*@keys+length $body;
+};
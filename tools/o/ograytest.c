@@ -0,0 +1,89 @@
+/* Check the gray span fast path of firmware/lcd/o.c against its per
+ * pixel shader_gray(): fill random paths solid to get their coverage,
+ * then gray, and compare every pixel. Exits nonzero on a mismatch. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define O_ENABLE_GRAY
+#include "lcd/o.c"
+
+uint8_t lcdBuffer[RESX*RESY_B];
+
+void lcdSetPixel(char x, char y, bool f){
+    uint8_t *p, bit;
+
+    if(x<0 || x>=RESX || y<0 || y>=RESY)
+        return;
+    p=&lcdBuffer[(RESY-(y+1))/8*RESX+(RESX-(x+1))];
+    bit=1<<((RESY-(y+1))%8);
+    if(f)
+        *p|=bit;
+    else
+        *p&=~bit;
+}
+
+bool lcdGetPixel(char x, char y){
+    return lcdBuffer[(RESY-(y+1))/8*RESX+(RESX-(x+1))]
+        & (1<<((RESY-(y+1))%8));
+}
+
+void lcdMarkDirty(int x0, int y0, int x1, int y1){
+}
+
+static void random_path(unsigned seed){
+    int n;
+
+    srand(seed);
+    n=3+rand()%8;
+    o_path_new();
+    o_move_to(rand()%(RESX+20)-10, rand()%(RESY+20)-10);
+    while(--n)
+        o_line_to(rand()%(RESX+20)-10, rand()%(RESY+20)-10);
+}
+
+#define ROUNDS 2000
+
+int main(void){
+    static char buf[2048];
+    static uint8_t mask[RESX*RESY_B];
+    unsigned seed=time(NULL);
+    long pixels=0;
+    int fail=0;
+
+    o_init(buf, sizeof(buf));
+    for(int r=0; r<ROUNDS && !fail; r++, seed++){
+        memset(lcdBuffer, 0, sizeof(lcdBuffer));
+        random_path(seed);
+        o_set_gray(1000);
+        o_fill();
+        memcpy(mask, lcdBuffer, sizeof(mask));
+
+        memset(lcdBuffer, 0, sizeof(lcdBuffer));
+        random_path(seed);
+        o_set_gray(500);
+        o_fill();
+
+        for(int y=0; y<RESY; y++)
+            for(int x=0; x<RESX; x++){
+                int i=(RESY-(y+1))/8*RESX+(RESX-(x+1));
+                int bit=1<<((RESY-(y+1))%8);
+                int want=(mask[i]&bit) ?
+                    shader_gray(x, y, (void*)(intptr_t)2) : 0;
+
+                if(!!(lcdBuffer[i]&bit) != want){
+                    printf("seed %u: pixel %d,%d is %d, shader_gray %d\n",
+                            seed, x, y, !want, want);
+                    fail=1;
+                    y=RESY;
+                    break;
+                };
+                pixels+=want;
+            };
+    };
+    if(!fail)
+        printf("%d paths, %ld gray pixels: OK\n", ROUNDS, pixels);
+    return fail;
+}